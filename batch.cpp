@@ -2,7 +2,9 @@
 #include "imageUtil.h"
 
 #include <iostream>	// cout and cerr streams
+#include <map>		// std::map
 #include <memory>	// auto_ptr (because of exceptions)
+#include <string>	// std::string
 
 #include <QDir>
 #include <QFileInfo>
@@ -16,19 +18,54 @@ using namespace std;
 /** A shortcut for Qt's QObject::tr */
 inline QString tr(const char *str) { return QObject::tr(str); }
 
+/** The maximal number of decoding iterations (decoding stops when the image converges) */
+const int MaxDecodeIterations= 30;
+
 /** Decodes a fractal image into a bitmap image */
 void decodeFile(const char *inpName,QString outName) {
 	auto_ptr<IRoot> root( IRoot::compatiblePrototype().clone(Module::ShallowCopy) );
 	if ( !root->fromFile(inpName) )
 		throw tr("Error while reading file \"%1\"") .arg(inpName);
 	root->decodeAct(MTypes::Clear);
-	root->decodeAct(MTypes::Iterate,10); //< \todo constant 10
+	root->decodeAct(MTypes::Converge,MaxDecodeIterations);
 	if ( !root->toImage().save(outName) )
 		throw tr("Error while writing file \"%1\"") .arg(outName);
 }
-/** Encodes a bitmap image into a fractal image using specified configuration file.
+/** Caches configured module trees for configuration files, so every file is read
+ *	(and its module tree built) only once per batch run */
+class ConfigCache {
+	typedef map<string,IRoot*> RootMap;
+	RootMap roots; ///< the configured root modules (owned), indexed by file names
+public:
+	/** Only deletes the cached roots */
+	~ConfigCache() {
+		for (RootMap::iterator it=roots.begin(); it!=roots.end(); ++it)
+			delete it->second;
+	}
+	/** Returns a root configured according to \p confName (or a default one
+	 *	for zero), the caller takes the ownership */
+	IRoot* newRoot(const char *confName) {
+		if (!confName)
+			return IRoot::compatiblePrototype().clone(Module::DeepCopy);
+		IRoot* &proto= roots[confName];
+		if (!proto) {
+		//	not cached yet -> read the configuration file
+			auto_ptr<IRoot> root( IRoot::compatiblePrototype().clone(Module::ShallowCopy) );
+			if ( !root->allSettingsFromFile(confName) ) {
+				roots.erase(confName);
+				throw tr("Error while reading configuration file \"%1\"") .arg(confName);
+			}
+			proto= root.release();
+		}
+		return proto->clone(Module::DeepCopy);
+	}
+}; // ConfigCache class
+
+/** Encodes a bitmap image into a fractal image using specified configuration file
+ *	(cached in \p configs).
  *	It also measures times, PSNRs, compression ratios, etc. and outputs the information. */
-void encodeFile(const char *inpName,QString outName,const char *confName=0) {
+void encodeFile( ConfigCache &configs, const char *inpName, QString outName
+, const char *confName=0 ) {
 //	load the bitmap
 	QImage image(inpName);
 	if (image.isNull())
@@ -39,12 +76,8 @@ void encodeFile(const char *inpName,QString outName,const char *confName=0) {
 	QTime time;
 	time.start();
 //	configure the module tree, using auto_ptr to release memory on exception
-	Module::CloneMethod clMethod= confName ? Module::ShallowCopy : Module::DeepCopy;
-	auto_ptr<IRoot> root( IRoot::compatiblePrototype().clone(clMethod) );
-	if (confName) {
-		 if ( !root->allSettingsFromFile(confName) )
-		     throw tr("Error while reading configuration file \"%1\"") .arg(confName);
-	} else
+	auto_ptr<IRoot> root( configs.newRoot(confName) );
+	if (!confName)
 		confName= "<default>";
 //	encode the image
 	if ( !root->encode(image) )
@@ -58,7 +91,7 @@ void encodeFile(const char *inpName,QString outName,const char *confName=0) {
 //	decode the image and measure the PSNR
 	time.restart();
 	root->decodeAct(MTypes::Clear);
-	root->decodeAct(MTypes::Iterate,10); //< \todo constant 10
+	int decIterations= root->decodeAct(MTypes::Converge,MaxDecodeIterations);
 	float decTime= time.elapsed()/1000.0;
 	vector<Real> psnr= Color::getPSNR( root->toImage(), image );
 //	output the information
@@ -67,7 +100,8 @@ void encodeFile(const char *inpName,QString outName,const char *confName=0) {
 		cout << psnr[i] << " ";	
 	Real grayRatio= image.width()*image.height() / Real(outSize);
 	cout << grayRatio << " " << 3*grayRatio << " ";	//< gray and color compression ratio
-	cout << encTime << " " << decTime << endl;		//< encoding and decoding time
+	cout << encTime << " " << decTime << " ";		//< encoding and decoding time
+	cout << decIterations << endl;					//< the number of decoding iterations
 }
 
 /** A functor providing filename classification into one of FileClassifier::FileType */
@@ -86,6 +120,8 @@ struct FileClassifier {
 
 /* Declared and commented in main.cpp */
 int batchRun(const vector<const char*> &names) {
+//	the configurations are kept for the whole run (like the worker threads in TaskPool)
+	ConfigCache configs;
 	try {
 	//	classify the types of the parameters
 		vector<FileClassifier::FileType> types;
@@ -151,7 +187,7 @@ int batchRun(const vector<const char*> &names) {
 					if (confStart-inpStart!=1) //< checking the input is single
 						throw tr("A single output file (\"%1\")"
 							" can only be used with single input") .arg(names[outpStart]);
-					encodeFile(names[inpStart],names[outpStart]);					
+					encodeFile(configs,names[inpStart],names[outpStart]);					
 					}
 					break;
 				case FileClassifier::Directory: // the output is a directory					
@@ -160,13 +196,13 @@ int batchRun(const vector<const char*> &names) {
 							+ QFileInfo(names[inputID]).completeBaseName() );
 							
 						if (confStart==outpStart) // using default configuration
-							encodeFile( names[inputID], outNameStart+".fci" ); 
+							encodeFile( configs, names[inputID], outNameStart+".fci" ); 
 						else {
 							outNameStart+= "_%1.fci";
 							for (int confID=confStart; confID<outpStart; ++confID) {
 								QString cName= QFileInfo(QString(names[confID]))
 									.completeBaseName();
-								encodeFile( names[inputID], outNameStart.arg(cName)
+								encodeFile( configs, names[inputID], outNameStart.arg(cName)
 									, names[confID] );
 							}
 						}
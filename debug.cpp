@@ -8,6 +8,7 @@
 #include "modules/quadTree.h"
 #include "modules/stdDomains.h"
 #include "modules/saupePredictor.h"
+#include "modules/classPredictor.h"
 
 #include <QBoxLayout>
 #include <QDialog>
@@ -335,4 +336,11 @@ QWidget* MSaupePredictor::debugModule(QPixmap &pixmap,const QPoint &click) {
 		.arg(predicted) .arg(maxpred) .arg(double(100)*predicted/(double)maxpred) );
 }
 
+QWidget* MClassPredictor::debugModule(QPixmap &pixmap,const QPoint &click) {
+	if ( pixmap.rect().contains(click) )
+		return 0;
+	return new QLabel( QString("Predicted %1/%2 (%3%)") 
+		.arg(predicted) .arg(maxpred) .arg(double(100)*predicted/(double)maxpred) );
+}
+
 #endif
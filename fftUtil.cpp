@@ -0,0 +1,75 @@
+#include "fftUtil.h"
+
+using namespace std;
+
+namespace NOSPACE {
+	using FFT::Complex;
+
+	/** Fills \p roots with the first n/2 powers of the primitive n-th root of unity
+	 *	(n = 2^\p log2n), the roots are conjugated for the \p inverse transform */
+	void makeRoots( int log2n, bool inverse, vector<Complex> &roots ) {
+		int half= powers[log2n]/2;
+		roots.resize(half);
+		double angle= ( inverse ? 2 : -2 ) * M_PI / powers[log2n];
+		for (int i=0; i<half; ++i)
+			roots[i]= Complex( cos(angle*i), sin(angle*i) );
+	}
+
+	/** Transforms a vector of 2^\p log2n elements using precomputed \p roots (see ::makeRoots) */
+	void transformWithRoots
+	( Complex *data, int log2n, int stride, const vector<Complex> &roots ) {
+		int n= powers[log2n];
+	//	reorder the elements by bit-reversed indices
+		for (int i=1, j=0; i<n; ++i) {
+			int bit= n>>1;
+			for (; j&bit; bit>>=1)
+				j^= bit;
+			j^= bit;
+			if (i<j)
+				swap( data[i*stride], data[j*stride] );
+		}
+	//	do the butterflies, from the shortest subvectors
+		for (int len=2, rootStep=n/2; len<=n; len*=2, rootStep/=2) {
+			int half= len/2;
+			for (int begin=0; begin<n; begin+=len)
+				for (int i=0; i<half; ++i) {
+					Complex &a= data[(begin+i)*stride], &b= data[(begin+i+half)*stride];
+					Complex bw= FFT::mul( b, roots[i*rootStep] );
+					b= a-bw;
+					a+= bw;
+				}
+		}
+	}
+}
+
+void FFT::transform( Complex *data, int log2n, bool inverse, int stride ) {
+	ASSERT( data && log2n>=0 && stride>0 );
+	vector<Complex> roots;
+	makeRoots(log2n,inverse,roots);
+	transformWithRoots(data,log2n,stride,roots);
+}
+
+void FFT::transformColumns( Complex *data, int log2h, bool inverse, int xBegin, int xEnd ) {
+	ASSERT( data && log2h>=0 && xBegin<=xEnd );
+	int height= powers[log2h];
+	vector<Complex> roots;
+	makeRoots(log2h,inverse,roots);
+	for (int x=xBegin; x<xEnd; ++x)
+		transformWithRoots( data+x*height, log2h, 1, roots );
+}
+
+void FFT::transformRows( Complex *data, int log2w, int log2h, bool inverse ) {
+	ASSERT( data && log2w>=0 && log2h>=0 );
+	int width= powers[log2w], height= powers[log2h];
+	vector<Complex> roots;
+	makeRoots(log2w,inverse,roots);
+//	every row is copied into a buffer to be contiguous
+	vector<Complex> row(width);
+	for (int y=0; y<height; ++y) {
+		for (int x=0; x<width; ++x)
+			row[x]= data[x*height+y];
+		transformWithRoots( &row[0], log2w, 1, roots );
+		for (int x=0; x<width; ++x)
+			data[x*height+y]= row[x];
+	}
+}
@@ -0,0 +1,38 @@
+#ifndef FFTUTIL_HEADER_
+#define FFTUTIL_HEADER_
+
+#include "headers.h"
+
+#include <complex>
+
+/** \file
+ *	Contains radix-2 fast Fourier transforms of complex vectors and column-major matrices.
+ *	All the transforms are in-place and the inverse transforms aren't normalized
+ *	(the result is multiplied by the number of the elements).
+*/
+
+/** Routines for fast Fourier transforms */
+namespace FFT {
+	typedef std::complex<double> Complex;
+
+	/** Returns the product of \p a and \p b (std::complex also handles infinities - slow) */
+	inline Complex mul(const Complex &a,const Complex &b) {
+		return Complex( a.real()*b.real() - a.imag()*b.imag()
+			, a.real()*b.imag() + a.imag()*b.real() );
+	}
+
+	/** Transforms a vector of 2^\p log2n elements of \p data placed every \p stride items */
+	void transform( Complex *data, int log2n, bool inverse, int stride=1 );
+	/** Transforms the columns [\p xBegin,\p xEnd) of a 2^\p log2w x 2^\p log2h matrix
+	 *	in \p data (column-major, contiguous columns of 2^\p log2h elements) */
+	void transformColumns( Complex *data, int log2h, bool inverse, int xBegin, int xEnd );
+	/** Transforms all the rows of a matrix (see ::transformColumns) */
+	void transformRows( Complex *data, int log2w, int log2h, bool inverse );
+	/** Transforms a matrix (see ::transformColumns) */
+	inline void transform2D( Complex *data, int log2w, int log2h, bool inverse ) {
+		transformColumns( data, log2h, inverse, 0, powers[log2w] );
+		transformRows( data, log2w, log2h, inverse );
+	}
+}
+
+#endif // FFTUTIL_HEADER_
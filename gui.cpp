@@ -254,14 +254,16 @@ void ImageViewer::encDone() {
 		QTime decTime;
 		decTime.start();
 		modules_encoding->decodeAct(MTypes::Clear);
-		modules_encoding->decodeAct(MTypes::Iterate,AutoIterationCount);
+		int decIterations= modules_encoding->decodeAct(MTypes::Converge,AutoIterationLimit);
 		int decMsecs= decTime.elapsed();
 
 		QImage afterImg= modules_encoding->toImage();
 		changePixmap( QPixmap::fromImage(afterImg) );
 	//	show some info
 		QString message= tr("Time to encode: %1 seconds\nTime to decode: %2 seconds\n")
-			.arg(encMsecs/1000.0) .arg(decMsecs/1000.0)	+ getPSNRmessage(beforeImg,afterImg);
+			.arg(encMsecs/1000.0) .arg(decMsecs/1000.0)
+			+ tr("Decoding iterations: %1\n") .arg(decIterations)
+			+ getPSNRmessage(beforeImg,afterImg);
 		QMessageBox::information( this, tr("encoded"), message );
 		encData.clear();
 	}
@@ -303,7 +305,7 @@ void ImageViewer::load() {
 	} else { // loading was successful
 		swap(encData,decData);
 		modules_encoding->decodeAct(Clear);
-		modules_encoding->decodeAct(MTypes::Iterate,AutoIterationCount);
+		modules_encoding->decodeAct(MTypes::Converge,AutoIterationLimit);
 		changePixmap( QPixmap::fromImage(modules_encoding->toImage()) );
 		updateActions();
 	}
@@ -371,7 +373,7 @@ bool ImageViewer::rezoom() {
 	}
 //	successfully reloaded -> auto-iterate the image and show it
 	modules_encoding->decodeAct(MTypes::Clear);
-	modules_encoding->decodeAct(MTypes::Iterate,AutoIterationCount);
+	modules_encoding->decodeAct(MTypes::Converge,AutoIterationLimit);
 	changePixmap( QPixmap::fromImage(modules_encoding->toImage()) );
 	updateActions();
 	return true;
@@ -38,7 +38,9 @@ class ImageViewer: public QMainWindow { Q_OBJECT
 	friend class SettingsDialog;
 	friend class EncodingProgress;
 	
-	static const int AutoIterationCount= 10;
+	/** The maximal number of iterations when decoding automatically
+	 *	(the decoding stops earlier if the image converges) */
+	static const int AutoIterationLimit= 30;
 
 	IRoot *modules_settings	///  Module tree holding current settings
 	, *modules_encoding;	///< Module tree that's currently encoding or the last one
@@ -21,8 +21,9 @@ namespace MTypes {
 	typedef SMatrix::Const CSMatrix;			///< Used for passing constant pixels
 	typedef std::vector<SMatrix> MatrixList;	///< A list of pixel matrices
 
-	enum DecodeAct { Clear, Iterate };			///< Possible decoding actions
-												// \todo name clash, etc.
+	/** Possible decoding actions: clearing, a fixed number of iterations
+	 *	and iterating until the image converges (count is the maximal number of iterations) */
+	enum DecodeAct { Clear, Iterate, Converge };	// \todo name clash, etc.
 
 	struct PlaneBlock; // declared and described later in the file
 	
@@ -59,8 +60,9 @@ struct IRoot: public Interface<IRoot> {
 	/** Encodes an image - returns false on exception, getMode() have to be to be Clear */
 	virtual bool encode
 		( const QImage &toEncode, const UpdateInfo &updateInfo=UpdateInfo::none ) =0;
-	/** Performs a decoding action (e.g.\ clearing, multiple iteration) */
-	virtual void decodeAct( DecodeAct action, int count=1 ) =0;
+	/** Performs a decoding action (e.g.\ clearing, multiple iteration),
+	 *	returns the number of iterations performed (the maximum for all parts) */
+	virtual int decodeAct( DecodeAct action, int count=1 ) =0;
 
 	/** Saves an encoded image into a stream, returns true on success */
 	virtual bool toStream(std::ostream &file) =0;
@@ -165,10 +167,14 @@ struct IShapeTransformer: public Interface<IShapeTransformer> {
 	/** Returns the number of jobs */
 	virtual int jobCount() =0;
 
+	/** Estimates the relative cost of encoding a job (used for scheduling the jobs),
+	 *	it's to be called after ::createJobs and before ::jobEncode */
+	virtual float jobCost(int jobIndex) =0;
 	/** Starts encoding a job - thread-safe (for different jobs) */
 	virtual void jobEncode(int jobIndex) =0;
-	/** Performs a decoding action for a job - thread-safe (for different jobs) */
-	virtual void jobDecodeAct( int jobIndex, DecodeAct action, int count=1 ) =0;
+	/** Performs a decoding action for a job - thread-safe (for different jobs),
+	 *	returns the number of iterations performed */
+	virtual int jobDecodeAct( int jobIndex, DecodeAct action, int count=1 ) =0;
 
 	/** Writes all settings (shared by all jobs) needed for later reconstruction */
 	virtual void writeSettings(std::ostream &file) =0;
@@ -235,6 +241,8 @@ struct ISquareRanges: public Interface<ISquareRanges> {
 	virtual void encode(const PlaneBlock &toEncode) =0;
 	/** Returns a reference to the current range-block list */
 	virtual const RangeList& getRangeList() const =0;
+	/** Returns the (inclusive) span of levels the range blocks can have */
+	virtual void getLevelSpan(int &minLevel,int &maxLevel) const =0;
 
 	/** Write all settings needed for reconstruction */
 	virtual void writeSettings(std::ostream &file) =0;
@@ -255,7 +263,7 @@ struct ISquareRanges::RangeNode: public Block {
 		float bestSE; ///< the best square error found until now
 	};
 
-	/// Encoders can store their data here, deleted in ::~RangeNode
+	/// Encoders can store their data here, owned (and freed) by the encoder
 	mutable EncoderData *encoderData;
 	/// The smallest integer such that the block fits into square with side of length 2^level
 	int level;
@@ -267,10 +275,6 @@ protected:
 	/** Constructor - initializes ::encoderData to zero, to be used by derived classes */
 	RangeNode(const Block &block,int level_)
 	: Block(block), encoderData(0), level(level_) {}
-	
-	/** Only deletes ::encoderData */
-	~RangeNode()
-		{ delete encoderData; }
 }; // ISquareRanges::RangeNode struct
 
 
@@ -287,6 +291,14 @@ struct ISquareDomains: public Interface<ISquareDomains> {
 	virtual void initPools(const PlaneBlock &planeBlock) =0;
 	/** Prepares domains in already initialized pools (and invalidates summers, etc.\ ) */
 	virtual void fillPixelsInPools(PlaneBlock &planeBlock) =0;
+	/** Updates the domains in already filled pools after the pixels of \p planeBlock
+	 *	changed in the \p changed block (the summers of updated pools are invalidated) */
+	virtual void refreshPixelsInPools(PlaneBlock &planeBlock,const Block &changed) =0;
+	/** Restricts the following ::fillPixelsInPools and ::refreshPixelsInPools calls
+	 *	to the \p regions of the pools (indexed like the pools, empty blocks for unused
+	 *	pools), the pixels outside them aren't valid then. An empty vector means
+	 *	whole pools (the default). Used by decoders that know the used domains. */
+	virtual void setNeededRegions(const std::vector<Block> &regions) =0;
 
 	/** Returns a reference to internal list of domain pools */
 	virtual const PoolList& getPools() const =0;
@@ -311,10 +323,13 @@ struct ISquareDomains::Pool: public SummedPixels {
 	float contrFactor;	///< The contractive factor (0,1) - the quotient of areas
 	
 	/** Constructor allocating the parent SummedPixels with correct dimensions 
-	 *	(increased according to \p zoom) */
+	 *	(increased according to \p zoom), the pixels are zeroed (they needn't be filled
+	 *	whole, see ISquareDomains::setNeededRegions) */
 	Pool(short width_,short height_,char type_,char level_,float cFactor,short zoom)
-	: type(type_), level(level_), contrFactor(cFactor)
-		{ setSize( lShift(width_,zoom), lShift(height_,zoom) ); }
+	: type(type_), level(level_), contrFactor(cFactor) {
+		setSize( lShift(width_,zoom), lShift(height_,zoom) );
+		pixels.fillSubMatrix( Block(0,0,width,height), 0 );
+	}
 };
 
 
@@ -324,6 +339,7 @@ struct ISquareDomains::Pool: public SummedPixels {
 struct ISquareEncoder: public Interface<ISquareEncoder> {
 	typedef IColorTransformer::Plane Plane;
 	typedef ISquareRanges::RangeNode RangeNode;
+	typedef ISquareRanges::RangeList RangeList;
 
 	/** Used by encoders, represents information about a domain pool on a level */
 	struct LevelPoolInfo {
@@ -337,12 +353,16 @@ struct ISquareEncoder: public Interface<ISquareEncoder> {
 	/** Initializes the module for encoding or decoding of a PlaneBlock */
 	virtual void initialize( IRoot::Mode mode, PlaneBlock &planeBlock ) =0;
 	/** Finds mapping with the best square error for a range (returns the SE),
-	 *	data neccessary for decoding are stored in RangeNode.encoderData */
-	virtual float findBestSE(const RangeNode &range,bool allowHigherSE=false) =0;
+	 *	data neccessary for decoding are stored in RangeNode.encoderData.
+	 *	The mappings of already encoded \p seedRanges (if nonzero; the parent, the sons
+	 *	or the neighbours of \p range) can be used to seed the search.
+	 *	It can be called concurrently for different ranges. */
+	virtual float findBestSE
+		( const RangeNode &range, bool allowHigherSE=false, const RangeList *seedRanges=0 ) =0;
 	/** Finishes encoding - to be ready for saving or decoding (can do some cleanup) */
 	virtual void finishEncoding() =0;
-	/** Performs a decoding action */
-	virtual void decodeAct( DecodeAct action, int count=1 ) =0;
+	/** Performs a decoding action, returns the number of iterations performed */
+	virtual int decodeAct( DecodeAct action, int count=1 ) =0;
 
 	/** Write all settings needed for reconstruction (don't depend on encoded thing) */
 	virtual void writeSettings(std::ostream &file) =0;
@@ -385,7 +405,15 @@ struct IStdEncPredictor: public Interface<IStdEncPredictor> {
 	/** Holds plenty precomputed information about the range block to be predicted for */
 	struct NewPredictorData;
 
-	/** Creates a predictor (passing the ownership) for a range block */
+	/** Prepares for predictions on the levels from \p minLevel to \p maxLevel
+	 *	(the span used by the range blocks) with some domains in \p levelPoolInfos
+	 *	(called by the encoder before the range blocks are encoded, it can use the current
+	 *	TaskPool), the predictors can also be prepared lazily in ::newPredictor */
+	virtual void prepare( const ISquareDomains::PoolList &pools
+	, const ISquareEncoder::LevelPoolInfos &levelPoolInfos, int minLevel, int maxLevel
+	, bool allowInversion ) =0;
+	/** Creates a predictor (passing the ownership) for a range block,
+	 *	it can be called concurrently */
 	virtual IOneRangePredictor* newPredictor(const NewPredictorData &data) =0;
 	/** Releases common resources (to be called when encoding is complete) */
 	virtual void cleanUp() =0;
@@ -1,8 +1,11 @@
 #ifndef KDTREE_HEADER_
 #define KDTREE_HEADER_
 
-#ifdef NDEBUG
-	#include <cstring> // memcpy
+#include "threadUtil.h"
+
+#include <cstring> // memcpy
+#ifdef __SSE__
+	#include <xmmintrin.h>
 #endif
 
 /** \file
@@ -75,11 +78,52 @@ namespace FieldMath {
 		return transform3( point, point+length, bounds, result
 			, MoveToBounds<T,CheckNaNs>() ) .sqrError;
 	}
+
+	/** Computes SEs (distances^2) of \p count vectors of \p length elements stored
+	 *	consecutively in \p vectors from \p point into \p result,
+	 *	if \p CheckNaNs is true, the coordinates where \p point is NaN are skipped */
+	template<class T,bool CheckNaNs> inline
+	void sqrDistances(const T *vectors,int count,int length,const T *point,T *result) {
+		for (; count; --count, vectors+= length) {
+			Real sum= 0;
+			for (int i=0; i<length; ++i)
+				if ( !CheckNaNs || !isNaN(point[i]) )
+					sum+= sqr( Real(vectors[i]) - point[i] );
+			*result++= sum;
+		}
+	}
+	#ifdef __SSE__
+	/** The SSE version of ::sqrDistances for floats (for lengths divisible by four) */
+	template<> inline void sqrDistances<float,false>
+	(const float *vectors,int count,int length,const float *point,float *result) {
+		if (length%4) {
+			for (; count; --count, vectors+= length) {
+				float sum= 0;
+				for (int i=0; i<length; ++i)
+					sum+= sqr( vectors[i]-point[i] );
+				*result++= sum;
+			}
+			return;
+		}
+		for (; count; --count, vectors+= length) {
+			__m128 sums= _mm_setzero_ps();
+			for (int i=0; i<length; i+=4) {
+				__m128 diffs= _mm_sub_ps( _mm_loadu_ps(vectors+i), _mm_loadu_ps(point+i) );
+				sums= _mm_add_ps( sums, _mm_mul_ps(diffs,diffs) );
+			}
+			sums= _mm_add_ps( sums, _mm_movehl_ps(sums,sums) );
+			sums= _mm_add_ss( sums, _mm_shuffle_ps(sums,sums,1) );
+			_mm_store_ss( result++, sums );
+		}
+	}
+	#endif
 }
 
 template<class T> class KDBuilder;
 /** A generic static KD-tree. Construction is done by KDBuilder::makeTree static method.
- *	The searching for nearest neighbours is performed by the PointHeap subclass. */
+ *	The searching for nearest neighbours is performed by the PointHeap subclass.
+ *	Every leaf holds a bucket of at most ::bucketSize vectors, for bigger buckets
+ *	the vectors are copied in the order of the leaves (to be scanned at once). */
 template<class T> class KDTree {
 public:
 	friend class KDBuilder<T>;
@@ -94,38 +138,60 @@ protected:
 	typedef T (*Bounds)[2];
 
 public:
-	const int depth	///  The depth of the tree = ::log2ceil(::count)
+	const int depth	///  The depth of the tree = ::log2ceil(::leafCount)
 	, length		///	 The length of the vectors
-	, count;		///< The number of the vectors
+	, count			///  The number of the vectors
+	, bucketSize	///  The maximal number of vectors in a leaf
+	, leafCount;	///< The number of leaves = ceil(::count/::bucketSize)
 protected:
 	Node *nodes;	///< The array of the tree-nodes (heap-like topology of the tree)
-	int *dataIDs;	///< Data IDs for children of "leaf" nodes
+	int *dataIDs;	///< Data IDs of the vectors in the order of the leaves
+	T *points;		///< The vectors in the order of ::dataIDs (only if ::bucketSize>1)
 	Bounds bounds;	///< The bounding box for all the data
 
-	/** Prepares to build a new KD-tree from \p count_ vectors of \p length_ elements */
-	KDTree(int length_,int count_)
-	: depth( log2ceil(count_) ), length(length_), count(count_)
-	, nodes( new Node[count_] ), dataIDs( new int[count_] ), bounds( new T[length_][2] ) {
+	/** Returns the number of leaves needed for \p count vectors in buckets of \p bucketSize */
+	static int getLeafCount(int count,int bucketSize)
+		{ return (count+bucketSize-1)/bucketSize; }
+
+	/** Prepares to build a new KD-tree from \p count_ vectors of \p length_ elements
+	 *	with at most \p bucketSize_ vectors in a leaf */
+	KDTree(int length_,int count_,int bucketSize_)
+	: depth( log2ceil(getLeafCount(count_,bucketSize_)) ), length(length_), count(count_)
+	, bucketSize(bucketSize_), leafCount( getLeafCount(count_,bucketSize_) )
+	, nodes( new Node[leafCount] ), dataIDs( new int[count_] )
+	, points( bucketSize_>1 ? new T[count_*length_] : 0 ), bounds( new T[length_][2] ) {
 	}
 
 	/** Copy constructor with moving semantics (destroys its argument) */
 	KDTree(KDTree &other)
 	: depth(other.depth), length(other.length), count(other.count)
-	, nodes(other.nodes), dataIDs(other.dataIDs), bounds(other.bounds) {
+	, bucketSize(other.bucketSize), leafCount(other.leafCount)
+	, nodes(other.nodes), dataIDs(other.dataIDs), points(other.points), bounds(other.bounds) {
 		other.nodes= 0;
 		other.dataIDs= 0;
+		other.points= 0;
 		other.bounds= 0;
 	}
 	
-	/** Takes an index of a "leaf" node (past the end of ::nodes) 
-	 *	and returns the appropriate data ID */
-	int leafID2dataID(int leafID) const {
-		ASSERT( count<=leafID && leafID<2*count );
+	/** Takes an index of a "leaf" node (past the end of ::nodes)
+	 *	and returns its position among the leaves (in the order of ::dataIDs) */
+	int leafID2position(int leafID) const {
+		ASSERT( leafCount<=leafID && leafID<2*leafCount );
 		int index= leafID-powers[depth];
 		if (index<0)
-			index+= count; // it is on the shallower side of the tree
-		ASSERT( 0<=index && index<count );
-		return dataIDs[index];
+			index+= leafCount; // it is on the shallower side of the tree
+		ASSERT( 0<=index && index<leafCount );
+		return index;
+	}
+	/** Returns the index of the first vector of the leaf on \p position (in ::dataIDs) */
+	int leafBegin(int position) const
+		{ return min( position*bucketSize, count ); }
+
+	/** Takes an index of a "leaf" node with one vector (past the end of ::nodes) 
+	 *	and returns the appropriate data ID */
+	int leafID2dataID(int leafID) const {
+		ASSERT( bucketSize==1 );
+		return dataIDs[ leafID2position(leafID) ];
 	}
 
 public:
@@ -134,13 +200,15 @@ public:
 	//	clean up
 		delete[] nodes;
 		delete[] dataIDs;
+		delete[] points;
 		delete[] bounds;
 	}
 
 	/** Performs a nearest-neighbour search by managing a heap from nodes of a KDTree.
 	 *	It returns vectors (their indices) in the order of ascending distance (SE)
 	 *	from a given fixed point. It can compute a lower bound of the SEs of the remaining
-	 *	vectors at any time. */
+	 *	vectors at any time. The leaves are ordered by the SEs of their bounding boxes,
+	 *	the vectors of a bucket are returned at once (ordered by their exact SEs). */
 	class PointHeap {
 		/** One element of the ::heap representing a node in the KDTree ::kd */
 		struct HeapNode {
@@ -159,59 +227,104 @@ public:
 			/** Returns pointer to the nearest point to this node's bounding box */
 			T* getNearest()		{ return data+1; }
 		};
+		/** The exact SE and the data ID of a vector in a bucket */
+		typedef std::pair<T,int> BucketVector;
 		/** Defines the order of ::heap - ascending according to ::getSE */
 		struct HeapOrder {
 			bool operator()(const HeapNode &a,const HeapNode &b)
 				{ return a.getSE() > b.getSE(); }
 		};
 
-		const KDTree &kd;			///< Reference to the KDTree we operate on
-		const T* const point;		///< Pointer to the point we are trying to approach
+		const KDTree *kd;			///< Pointer to the KDTree we operate on
+		const T *point;				///< Pointer to the point we are trying to approach
 		vector<HeapNode> heap;		///< The current heap of the tree nodes
 		BulkAllocator<T> allocator;	///< The allocator for HeapNode::data
+		vector<BucketVector> bucket;///< The rest of the last popped bucket (the nearest last)
+		T bucketSE;					///< The SE of the last popped bucket's bounding box
+		vector<T> bucketSEs;		///< Temporary storage for the SEs of a bucket's vectors
 	public:
+		/** Creates an empty heap, ::reset has to be called before using it */
+		PointHeap()
+		: kd(0), point(0) {}
 		/** Builds the heap from a KDTree \p tree and vector \p point_
 		 *	(they've got to remain valid until the destruction of this instance) */
 		PointHeap(const KDTree &tree,const T *point_,bool checkNaNs)
-		: kd(tree), point(point_) {
+			{ reset(tree,point_,checkNaNs); }
+
+		/** Rebuilds the heap from a KDTree \p tree and vector \p point_
+		 *	(they've got to remain valid until the next reset or destruction),
+		 *	the already allocated memory is reused */
+		void reset(const KDTree &tree,const T *point_,bool checkNaNs) {
+			kd= &tree;
+			point= point_;
 			ASSERT(point);
-		//	create the root heap-node
-			HeapNode rootNode( 1, allocator.makeField(kd.length+1) );
+			heap.clear();
+			bucket.clear();
+			allocator.reset();
+		//	create the root heap-node (the root is a leaf if there is only one bucket)
+			HeapNode rootNode( 1, allocator.makeField(kd->length+1) );
 		//	compute the nearest point within the global bounds and corresponding SE
 			using namespace FieldMath;
 			rootNode.getSE()= checkNaNs
-				? moveToBounds_copy<T,true> ( point, kd.bounds, kd.length, rootNode.getNearest() )
-				: moveToBounds_copy<T,false>( point, kd.bounds, kd.length, rootNode.getNearest() );
+				? moveToBounds_copy<T,true> ( point, kd->bounds, kd->length, rootNode.getNearest() )
+				: moveToBounds_copy<T,false>( point, kd->bounds, kd->length, rootNode.getNearest() );
 		//	push it onto the heap (and reserve more to speed up the first leaf-gettings)
-			heap.reserve(kd.depth*2);
+			heap.reserve(kd->depth*2);
 			heap.push_back(rootNode);
 		}
 
 		/** Returns whether the heap is empty ( !isEmpty() is needed for all other methods) */
 		bool isEmpty()
-			{ return heap.empty(); }
+			{ return heap.empty() && bucket.empty(); }
 
 		/** Returns the SE of the top node (always equals the SE of the next leaf) */
 		T getTopSE() {
 			ASSERT( !isEmpty() );
-			return heap[0].getSE();
+			return bucket.empty() ? heap[0].getSE() : bucketSE;
 		}
 
-		/** Removes a leaf, returns the matching vector's index,
-		 *	assumes it's safe to discard nodes further than \p maxSE */
+		/** Removes a leaf (or a vector of the last bucket), returns the matching vector's
+		 *	index, assumes it's safe to discard nodes further than \p maxSE. For buckets
+		 *	of more vectors it can find out none of them is near enough,
+		 *	then the bucket is discarded and -1 is returned. */
 		template<bool CheckNaNs> int popLeaf(T maxSE) {
-		//	ensure a leaf is on the top of the heap and get its ID
-			makeTopLeaf<CheckNaNs>(maxSE);
-			int result= kd.leafID2dataID( heap.front().nodeIndex );
-		//	remove the top from the heap (no need to free the memory - ::allocator)
-			pop_heap( heap.begin(), heap.end(), HeapOrder() );
-			heap.pop_back();
+			if ( bucket.empty() ) {
+			//	ensure a leaf is on the top of the heap
+				makeTopLeaf<CheckNaNs>(maxSE);
+				int leafID= heap.front().nodeIndex;
+				bucketSE= heap.front().getSE();
+			//	remove the top from the heap (no need to free the memory - ::allocator)
+				pop_heap( heap.begin(), heap.end(), HeapOrder() );
+				heap.pop_back();
+				if ( !kd->points ) // single-vector leaves are returned at once
+					return kd->leafID2dataID(leafID);
+				fillBucket<CheckNaNs>(leafID,maxSE);
+				if ( bucket.empty() )
+					return -1;
+			}
+		//	return the nearest remaining vector of the last bucket
+			int result= bucket.back().second;
+			bucket.pop_back();
 			return result;
 		}
 	protected:
 		/** Divides the top nodes until there's a leaf on the top
 		 *	assumes it's safe to discard nodes further than \p maxSE */
 		template<bool CheckNaNs> void makeTopLeaf(T maxSE);
+		/** Fills ::bucket with the vectors of leaf \p leafID not further than \p maxSE
+		 *	(computing their exact SEs) */
+		template<bool CheckNaNs> void fillBucket(int leafID,T maxSE) {
+			int position= kd->leafID2position(leafID);
+			int begin= kd->leafBegin(position), bucketCount= kd->leafBegin(position+1)-begin;
+			bucketSEs.resize(kd->bucketSize);
+			FieldMath::sqrDistances<T,CheckNaNs>
+				( kd->points+begin*kd->length, bucketCount, kd->length, point, &bucketSEs[0] );
+			for (int i=0; i<bucketCount; ++i)
+				if ( bucketSEs[i] <= maxSE )
+					bucket.push_back( BucketVector( bucketSEs[i], kd->dataIDs[begin+i] ) );
+		//	sort the vectors to have the nearest at the back
+			sort( bucket.begin(), bucket.end(), greater<BucketVector>() );
+		}
 
 	}; // PointHeap class
 }; // KDTree class
@@ -221,13 +334,13 @@ template<class T> template<bool CheckNaNs>
 void KDTree<T>::PointHeap::makeTopLeaf(T maxSE) {
 	ASSERT( !isEmpty() );
 //	exit if there's a leaf on the top already
-	if ( heap[0].nodeIndex >= kd.count )
+	if ( heap[0].nodeIndex >= kd->leafCount )
 		return;
 	PtrInt oldHeapSize= heap.size();
 	HeapNode heapRoot= heap[0]; // making a local working copy of the top of the heap
 
-	do { // while heapRoot isn't leaf ... while ( heapRoot.nodeIndex<kd.count )
-		const Node &node= kd.nodes[heapRoot.nodeIndex];
+	do { // while heapRoot isn't leaf ... while ( heapRoot.nodeIndex<kd->leafCount )
+		const Node &node= kd->nodes[heapRoot.nodeIndex];
 	//	now replace the node with its two children:
 	//		one of them will have the same SE (replaces its parent on the top),
 	//		the other one can have higher SE (push_back-ed on the heap)
@@ -253,17 +366,17 @@ void KDTree<T>::PointHeap::makeTopLeaf(T maxSE) {
 			continue;
 	//	create a new heap-node, allocate it's data and assign index of the other child
 		HeapNode newHNode;
-		newHNode.data= allocator.makeField(kd.length+1);
+		newHNode.data= allocator.makeField(kd->length+1);
 		newHNode.getSE()= newSE;	
 		newHNode.nodeIndex= heapRoot.nodeIndex-goRight+!goRight;
 	//	the nearest point of the new heap-node only differs in one coordinate
-		FieldMath::assign( heapRoot.getNearest(), kd.length, newHNode.getNearest() );
+		FieldMath::assign( heapRoot.getNearest(), kd->length, newHNode.getNearest() );
 		if (validCoord)
 			newHNode.getNearest()[node.coord]= node.threshold;
 	//	add the new node to the back, restore the heap-property later
 		heap.push_back(newHNode);
 		
-	} while ( heapRoot.nodeIndex < kd.count );
+	} while ( heapRoot.nodeIndex < kd->leafCount );
 
 	heap[0]= heapRoot; // restoring the working copy of the heap's top node
 //	restore the heap-property on the added nodes
@@ -279,30 +392,49 @@ public:
 	typedef KDTree<T> Tree;
 	typedef T BoundsPair[2];
 	typedef typename Tree::Bounds Bounds;
-	/** Type for a method that chooses which coordinate to split */
+	/** Type for a method that chooses which coordinate to split, \p tmp is a temporary
+	 *	array of ::depth+1 bounding boxes (for every depth on the path to the node) */
 	typedef int (KDBuilder::*CoordChooser)
-		(int nodeIndex,int *beginIDs,int *endIDs,int depthLeft) const;
+		(int nodeIndex,int *beginIDs,int *endIDs,int depthLeft,Bounds tmp) const;
 protected:
 	using Tree::depth;	using Tree::length;		using Tree::count;
 	using Tree::nodes;	using Tree::dataIDs;	using Tree::bounds;
+	using Tree::bucketSize;	using Tree::leafCount;	using Tree::points;
+	using Tree::leafBegin;
+
+	/** The minimal number of vectors in a subtree to build its halves in parallel */
+	enum { MinParallelCount=4096 };
+
+	class SubtreeTask; // forward declaration, defined later in the file
 
 	const T *data;
 	const CoordChooser chooser;
-	mutable Bounds chooserTmp;
+	TaskPool *taskPool;	///< the pool to build big subtrees in parallel (or zero)
 
-	KDBuilder(const T *data_,int length,int count,CoordChooser chooser_)
-	: Tree(length,count), data(data_), chooser(chooser_), chooserTmp(0) {
-		ASSERT( length>0 && count>0 && chooser && data );
+	KDBuilder( const T *data_, int length, int count, int bucketSize, CoordChooser chooser_
+	, TaskPool *taskPool_ )
+	: Tree(length,count,bucketSize), data(data_), chooser(chooser_), taskPool(taskPool_) {
+		ASSERT( length>0 && count>0 && bucketSize>0 && chooser && data );
 	//	create the index-vector, coumpute the bounding box, build the tree
 		for (int i=0; i<count; ++i)
 			dataIDs[i]= i;
 		getBounds(bounds);
-		if (count>1)
-			buildNode(1,dataIDs,dataIDs+count,depth);
-		delete[] chooserTmp;
-		DEBUG_ONLY( chooserTmp= 0; data= 0; )
+		if (leafCount>1) {
+			Bounds tmp= newTmpBounds();
+			buildNode(1,0,leafCount,depth,tmp);
+			delete[] tmp;
+		}
+	//	copy the vectors in the order of the leaves (for buckets)
+		if (points)
+			for (int i=0; i<count; ++i)
+				memcpy( points+i*length, data+dataIDs[i]*length, length*sizeof(T) );
+		DEBUG_ONLY( data= 0; )
 	}
 
+	/** Allocates a temporary array of bounding boxes for the coordinate choosers */
+	Bounds newTmpBounds() const
+		{ return new BoundsPair[length*(depth+1)]; }
+
 	/** Creates bounds containing one value */
 	struct NewBounds {
 		void operator()(const T &val,BoundsPair &bounds) const
@@ -348,31 +480,61 @@ protected:
 	}
 
 	/** Recursively builds node \p nodeIndex and its subtree of depth \p depthLeft
- 	*	(including leaves), operates on data \p data in the range [\p beginIDs,\p endIDs) */
-	void buildNode(int nodeIndex,int *beginIDs,int *endIDs,int depthLeft);
+ 	*	(including leaves), operates on the leaves [\p beginLeaf,\p endLeaf)
+	*	(their vectors are given by ::dataIDs), \p tmp are the temporary bounds
+	*	for the ::chooser. Big subtrees are built in parallel if there is a ::taskPool. */
+	void buildNode(int nodeIndex,int beginLeaf,int endLeaf,int depthLeft,Bounds tmp);
 
 public:
 	/** Builds a KDTree from \p count vectors of length \p length stored in \p data,
-	 *	splitting the nodes by \p chooser CoordChooser */
-	static Tree* makeTree(const T *data,int length,int count,CoordChooser chooser) {
-		KDBuilder builder(data,length,count,chooser);
+	 *	with at most \p bucketSize vectors in a leaf, splitting the nodes
+	 *	by \p chooser CoordChooser, big subtrees are built as tasks in \p taskPool
+	 *	(if nonzero; it has to be the current pool) */
+	static Tree* makeTree( const T *data, int length, int count, CoordChooser chooser
+	, int bucketSize=1, TaskPool *taskPool=0 ) {
+		ASSERT( !taskPool || taskPool==TaskPool::current() );
+		KDBuilder builder(data,length,count,bucketSize,chooser,taskPool);
 	//	moving only the necesarry data (pointers) into a new copy
 		return new Tree(builder);
 	}
 	
 	/** CoordChooser choosing the longest coordinate of the bounding box of the current interval */
-	int choosePrecise(int nodeIndex,int *beginIDs,int *endIDs,int /*depthLeft*/) const;
+	int choosePrecise(int nodeIndex,int *beginIDs,int *endIDs,int /*depthLeft*/,Bounds) const;
 	/** CoordChooser choosing the coordinate only according to the depth */
-	int chooseFast(int /*nodeIndex*/,int* /*beginIDs*/,int* /*endIDs*/,int depthLeft) const
+	int chooseFast(int /*nodeIndex*/,int* /*beginIDs*/,int* /*endIDs*/,int depthLeft,Bounds) const
 		{ return depthLeft%length; }
 	/** CoordChooser choosing a random coordinate */
-	int chooseRand(int /*nodeIndex*/,int* /*beginIDs*/,int* /*endIDs*/,int /*depthLeft*/) const
+	int chooseRand(int /*nodeIndex*/,int* /*beginIDs*/,int* /*endIDs*/,int /*depthLeft*/,Bounds) const
 		{ return rand()%length; }
 	/** CoordChooser - like ::choosePrecise, but doesn't compute the real bounding box,
 	 *	only approximates it by splitting the parent's box (a little less accurate, but much faster) */
-	int chooseApprox(int nodeIndex,int* /*beginIDs*/,int* /*endIDs*/,int depthLeft) const;
+	int chooseApprox(int nodeIndex,int* /*beginIDs*/,int* /*endIDs*/,int depthLeft,Bounds tmp) const;
 }; // KDBuilder class
 
+/** Builds a subtree as a task in TaskPool (with its own copy of the temporary bounds) */
+template<class T> class KDBuilder<T>::SubtreeTask: public QRunnable {
+	KDBuilder *builder;	///< the builder of the tree
+	int nodeIndex		///  the root node of the subtree
+	, beginLeaf			///  the first leaf of the subtree
+	, endLeaf			///  the leaf past the subtree
+	, depthLeft;		///< the depth of the subtree
+	Bounds tmp;			///< the temporary bounds (owned)
+public:
+	/** Initializes the members, copies \p tmp_ bounds */
+	SubtreeTask( KDBuilder *builder_, int nodeIndex_, int beginLeaf_, int endLeaf_
+	, int depthLeft_, const Bounds tmp_ )
+	: builder(builder_), nodeIndex(nodeIndex_), beginLeaf(beginLeaf_), endLeaf(endLeaf_)
+	, depthLeft(depthLeft_), tmp( builder_->newTmpBounds() ) {
+		memcpy( tmp, tmp_, builder->length*(builder->depth+1)*sizeof(BoundsPair) );
+	}
+	/** Only frees the temporary bounds */
+	~SubtreeTask()
+		{ delete[] tmp; }
+	/** Builds the subtree (virtual method) */
+	void run()
+		{ builder->buildNode(nodeIndex,beginLeaf,endLeaf,depthLeft,tmp); }
+}; // KDBuilder<T>::SubtreeTask class
+
 
 
 namespace NOSPACE {
@@ -400,7 +562,7 @@ namespace NOSPACE {
 	};
 }
 template<class T> int KDBuilder<T>
-::choosePrecise(int nodeIndex,int *beginIDs,int *endIDs,int) const {
+::choosePrecise(int nodeIndex,int *beginIDs,int *endIDs,int,Bounds) const {
 	ASSERT( nodeIndex>0 && beginIDs && endIDs && beginIDs<endIDs );
 //	temporary storage for computed bounding box
 	BoundsPair boundsStorage[length];
@@ -418,33 +580,23 @@ template<class T> int KDBuilder<T>
 	return mdc.bestIndex;
 }
 
-template<class T> int KDBuilder<T>::chooseApprox(int nodeIndex,int*,int*,int) const {
-	using namespace FieldMath;
+template<class T> int KDBuilder<T>
+::chooseApprox(int nodeIndex,int*,int*,int,Bounds tmp) const {
 	ASSERT(nodeIndex>0);
 
 	int myDepth= log2ceil(nodeIndex+1)-1;
+	Bounds myBounds= tmp+length*myDepth;
 	if (!myDepth) { // I'm in the root - copy the bounds
 		ASSERT(nodeIndex==1);
-		chooserTmp= new BoundsPair[length*(depth+1)]; // allocate my temporary bound-array
-		assign( bounds, length, chooserTmp );
-	}
-
-	Bounds myBounds= chooserTmp+length*myDepth;
-	if (myDepth) { // I'm not the root - copy parent's bounds and modify them
+		memcpy( myBounds, bounds, length*sizeof(BoundsPair) );
+	} else { // I'm not the root - copy parent's bounds and modify them
+	//	(the brother's bounds needn't be there, it may be built in parallel)
 		const typename Tree::Node &parent= nodes[nodeIndex/2];
-		Bounds parentBounds= myBounds-length;
-		if (nodeIndex%2) {	// I'm the right son -> bounds on this level not initialized
-			assign( parentBounds, length, myBounds );		// copying parent bounds
-			myBounds[parent.coord][0]= parent.threshold;	// adjusting the lower bound
-		} else // I'm the left son
-			if ( nodeIndex+1 < count ) { // almost the same as brother -> only adjust the coordinate
-				myBounds[parent.coord][0]= parentBounds[parent.coord][0];
-				myBounds[parent.coord][1]= parent.threshold;
-			} else { // I've got no brother
-				ASSERT( nodeIndex+1 == count );
-				assign( parentBounds, length, myBounds );
-				myBounds[parent.coord][1]= parent.threshold;
-			}
+		memcpy( myBounds, myBounds-length, length*sizeof(BoundsPair) );
+		if (nodeIndex%2)	// I'm the right son -> adjusting the lower bound
+			myBounds[parent.coord][0]= parent.threshold;
+		else				// I'm the left son -> adjusting the upper bound
+			myBounds[parent.coord][1]= parent.threshold;
 	}
 //	find out the widest dimension
 	MaxDiffCoord<T> mdc= for_each( myBounds+1, myBounds+length, MaxDiffCoord<T>(myBounds[0]) );
@@ -465,18 +617,20 @@ namespace NOSPACE {
 	};
 }
 template<class T> void KDBuilder<T>
-::buildNode(int nodeIndex,int *beginIDs,int *endIDs,int depthLeft) {
-	int count= endIDs-beginIDs; // owershadowing Tree::count
-//	check we've got at least one vector and the depth&count are adequate to each other
+::buildNode(int nodeIndex,int beginLeaf,int endLeaf,int depthLeft,Bounds tmp) {
+	int count= endLeaf-beginLeaf; // owershadowing Tree::count (counting leaves)
+//	check we've got at least two leaves and the depth&count are adequate to each other
 	ASSERT( count>=2 && powers[depthLeft-1]<count && count<=powers[depthLeft] );
 	--depthLeft;
-//	find out where to split - how many items should be on the left to have the heap-shape
+//	find out where to split - how many leaves should be on the left to have the heap-shape
 	bool shallowRight= ( count <= powers[depthLeft]+powers[depthLeft-1] );
-	int *middle= shallowRight
-		? endIDs-powers[depthLeft-1]
-		: beginIDs+powers[depthLeft];
+	int middleLeaf= shallowRight
+		? endLeaf-powers[depthLeft-1]
+		: beginLeaf+powers[depthLeft];
+	int *beginIDs= dataIDs+leafBegin(beginLeaf), *endIDs= dataIDs+leafBegin(endLeaf)
+	, *middle= dataIDs+leafBegin(middleLeaf);
 //	find out the dividing coordinate and find the "median" in this coordinate
-	int coord= (this->*chooser)(nodeIndex,beginIDs,endIDs,depthLeft);
+	int coord= (this->*chooser)(nodeIndex,beginIDs,endIDs,depthLeft,tmp);
 	nth_element( beginIDs, middle , endIDs, IndexComparator<T>(data,length,coord) );
 //	fill the node's data (dividing coordinate and its threshold)
 	nodes[nodeIndex].coord= coord;
@@ -484,11 +638,27 @@ template<class T> void KDBuilder<T>
 //	recurse on both halves (if needed; fall-through switch)
 	switch (count) {
 	default: //	we've got enough nodes - build both subtrees (fall through)
+		if ( taskPool && endIDs-beginIDs>=MinParallelCount ) {
+		//	build the right subtree as a task and the left one meanwhile
+			TaskGroup group;
+			taskPool->start( new SubtreeTask
+				( this, 2*nodeIndex+1, middleLeaf, endLeaf, depthLeft-shallowRight, tmp ), group );
+			bool failed= false;
+			try {
+				buildNode( 2*nodeIndex, beginLeaf, middleLeaf, depthLeft, tmp );
+			} catch (exception &e) {
+				failed= true;
+			}
+		//	the task refers to our data -> wait for it even in case of failure
+			taskPool->wait(group);
+			checkThrow( !failed && !group.hasFailed() );
+			break;
+		}
 	//	build the right subtree
-		buildNode( 2*nodeIndex+1, middle, endIDs, depthLeft-shallowRight );
+		buildNode( 2*nodeIndex+1, middleLeaf, endLeaf, depthLeft-shallowRight, tmp );
 	case 3: // only a pair in the first half
 	//	build the left subtree
-		buildNode( 2*nodeIndex, beginIDs, middle, depthLeft );
+		buildNode( 2*nodeIndex, beginLeaf, middleLeaf, depthLeft, tmp );
 	case 2: // nothing needs to be sorted
 		;
 	}
@@ -1,5 +1,6 @@
 #include "gui.h"
 #include "modules.h"
+#include "threadUtil.h"
 
 using namespace std;
 
@@ -41,6 +42,7 @@ int main(int argc,char **argv) {
 		result= batchRun(fileNames);
 	}
 	
+	TaskPool::destroyShared();
 	ModuleFactory::destroy();
 	return result;
 }
@@ -1,6 +1,10 @@
 #ifndef MATRIXUTIL_HEADER_
 #define MATRIXUTIL_HEADER_
 
+#ifdef __SSE2__
+	#include <emmintrin.h>
+#endif
+
 /** A simple structure representing a rectangle */
 struct Block {
 	short x0, y0, xend, yend;
@@ -11,6 +15,8 @@ struct Block {
 
 	bool contains(short x,short y) const
 		{ return x0<=x && x<xend && y0<=y && y<yend; }
+	bool contains(const Block &block) const
+		{ return x0<=block.x0 && block.xend<=xend && y0<=block.y0 && block.yend<=yend; }
 
 	Block() {}
 	Block(short x0_,short y0_,short xend_,short yend_)
@@ -19,6 +25,27 @@ struct Block {
 
 ////    Matrix templates
 
+/** The alignment (in bytes) of matrix columns allocated by MatrixSlice::allocateAligned */
+enum { MatrixAlignment=64 };
+
+/** Allocates uninitialized memory for \p count objects of type \p T aligned
+ *	to MatrixAlignment bytes, it has to be released by freeAligned() */
+template<class T> T* allocAligned(PtrInt count) {
+	ASSERT( count>=0 );
+//	the original pointer is stored just before the aligned block
+	char *raw= new char[ count*sizeof(T) + MatrixAlignment + sizeof(char*) ];
+	char *result= raw + sizeof(char*);
+	result+= ( MatrixAlignment - (PtrInt)result%MatrixAlignment ) % MatrixAlignment;
+	reinterpret_cast<char**>(result)[-1]= raw;
+	return reinterpret_cast<T*>(result);
+}
+/** Releases memory allocated by allocAligned() (zero is ignored) */
+template<class T> void freeAligned(T *memory) {
+	if (memory)
+		delete[] reinterpret_cast<char**>( const_cast<char*>(
+			reinterpret_cast<const char*>(memory) ) )[-1];
+}
+
 /** A simple generic template for matrices of fixed size, uses shallow copying
  *	and manual memory management */
 template<class T,class I=PtrInt> struct MatrixSlice {
@@ -57,22 +84,45 @@ template<class T,class I=PtrInt> struct MatrixSlice {
 	}
 
 	/** Reallocates the matrix for a new size. If \p memory parameter is given,
-	 *	it is used for storage (the user is responsible that the matrix fits in it, etc.) */
+	 *	it is used for storage (the user is responsible that the matrix fits in it, etc.\ ,
+	 *	it has to be allocated by allocAligned() if ::free is to be called).
+	 *	The elements aren't constructed, so \p T should be a plain type. */
 	void allocate( I width, I height, T *memory=0 ) {
 		ASSERT( width>0 && height>0 );
 		free();
-		start= memory ? memory : new T[width*height];
+		start= memory ? memory : allocAligned<T>(width*height);
 		colSkip= height;
 	}
+	/** Reallocates the matrix for a new size, every column is aligned to MatrixAlignment
+	 *	bytes (#colSkip is padded), so vectorized routines can process whole columns
+	 *	by aligned accesses. The stride is also kept off multiples of 4kB, where walking
+	 *	across the columns would hit the same cache sets again and again. */
+	void allocateAligned( I width, I height ) {
+		ASSERT( width>0 && height>0 );
+		free();
+		colSkip= height;
+		if ( MatrixAlignment%sizeof(T) == 0 ) {
+			const I align= MatrixAlignment/sizeof(T);
+			colSkip= (height+align-1) / align * align;
+			if ( colSkip*sizeof(T) % 4096 == 0 )
+				colSkip+= align;
+		}
+		start= allocAligned<T>(width*colSkip);
+	}
 	/** Releases the memory */
 	void free() {
-		delete[] start;
+		freeAligned(start);
 		start= 0;
 	}
 	/** Returns whether the matrix is allocated (and thus usable for indexing) */
 	bool isValid() const {
 		return start;
 	}
+	/** Returns whether all the columns begin on multiples of \p bytes (a power of two) */
+	bool hasAlignedColumns(int bytes) const {
+		ASSERT( isValid() );
+		return (PtrInt)start % bytes == 0 && colSkip*sizeof(T) % bytes == 0;
+	}
 
 	/** Fills a submatrix of a valid matrix with a value */
 	void fillSubMatrix(const Block &block,T value) {
@@ -132,24 +182,54 @@ template<class T,class I=PtrInt> struct MatrixSummer {
 	/** Prepares object to make sums for a matrix. If the summer has already been
 	 *	used before, the method assumes it was for a matrix of the same size */
 	template<class Input> void fill(Input inp,I width,I height) {
+		prepare(width,height);
+		fillPartialSums(sums,inp,width,height);
+	}
+
+	/** Prepares the object for filling by parts - ::fillColumns for all the columns
+	 *	and then ::fillRows for all the rows (the parts of one phase can run concurrently),
+	 *	assumes the same size as ::fill */
+	void prepare(I width,I height) {
 		if ( !sums.isValid() )
-			sums.allocate(width+1,height+1);
+			sums.allocateAligned(width+1,height+1);
+	}
+	/** Sums the columns [\p xBegin,\p xEnd) of \p inp (the first phase of filling by parts) */
+	template<class Input> void fillColumns(Input inp,I xBegin,I xEnd,I height)
+		{ sumColumns(sums,inp,xBegin,xEnd,height); }
+	/** Sums the rows [\p yBegin,\p yEnd) of the matrix (the second phase of filling by parts) */
+	void fillRows(I width,I yBegin,I yEnd)
+		{ sumRows(sums,width,yBegin,yEnd); }
+}; // MatrixSummer class template
 
-	//	fill the edges with zeroes
-		for (I i=0; i<=width; ++i)
-			sums[i][0]= 0;
-		for (I j=1; j<=height; ++j)
+/** Fills the first column and row of \p sums and accumulates the columns [\p xBegin,\p xEnd)
+ *	of \p inp in the y-growing direction into the next columns of \p sums
+ *	(the first phase of MatrixSummer::fill, generic version) */
+template<class T,class I,class Input>
+void sumColumns( MatrixSlice<T,I> sums, Input inp, I xBegin, I xEnd, I height ) {
+	typedef T Result;
+	if (!xBegin)
+		for (I j=0; j<=height; ++j)
 			sums[0][j]= 0;
-	//	acummulate in the y-growing direction
-		for (I i=1; i<=width; ++i)
-			for (I j=1; j<=height; ++j)
-				sums[i][j]= sums[i][j-1] + Result(inp[i-1][j-1]);
-	//	acummulate in the x-growing direction
-		for (I i=2; i<=width; ++i)
-			for (I j=1; j<=height; ++j)
-				sums[i][j]+= sums[i-1][j];
+	for (I i=xBegin+1; i<=xEnd; ++i) {
+		sums[i][0]= 0;
+		for (I j=1; j<=height; ++j)
+			sums[i][j]= sums[i][j-1] + Result(inp[i-1][j-1]);
 	}
-}; // MatrixSummer class template
+}
+/** Accumulates the rows [\p yBegin,\p yEnd) of \p sums in the x-growing direction
+ *	(the second phase of MatrixSummer::fill, generic version) */
+template<class T,class I>
+void sumRows( MatrixSlice<T,I> sums, I width, I yBegin, I yEnd ) {
+	for (I i=2; i<=width; ++i)
+		for (I j=yBegin+1; j<=yEnd; ++j)
+			sums[i][j]+= sums[i-1][j];
+}
+/** Fills \p sums with partial sums of \p inp for MatrixSummer::fill (generic version) */
+template<class T,class I,class Input>
+void fillPartialSums( MatrixSlice<T,I> sums, Input inp, I width, I height ) {
+	sumColumns(sums,inp,0,width,height);
+	sumRows(sums,width,0,height);
+}
 
 /** Helper structure for computing with value and squared sums at once */
 template<class Num> struct DoubleNum {
@@ -183,24 +263,235 @@ template<class Num> struct DoubleNum {
 }; // DoubleNum template struct
 
 
+#ifdef __SSE2__
+/** SSE2 versions of the MatrixSummer filling routines for the sums of values and squares
+ *	of floats, a DoubleNum<double> is handled as one vector (the columns of the sums
+ *	have to be aligned, as allocated by MatrixSummer), the results are bit-identical
+ *	to the generic versions */
+namespace SummerSSE2 {
+	typedef DoubleNum<double> Sums;
+
+	/** Returns the address of the sums of the pixel [\p x][\p y] as doubles */
+	template<class I> inline double* at(MatrixSlice<Sums,I> sums,PtrInt x,PtrInt y)
+		{ return &sums[x][y].value; }
+	/** Returns the (value,square) vector of \p pixel */
+	inline __m128d pixelSums(float pixel) {
+		__m128d v= _mm_set1_pd(pixel);
+		return _mm_mul_pd( v, _mm_unpacklo_pd(_mm_set_sd(1),v) ); // (v*1,v*v)
+	}
+	/** Zeroes the first element of the columns [\p xBegin,\p xEnd] and for \p xBegin==0
+	 *	also the whole first column */
+	template<class I>
+	inline void zeroEdges(MatrixSlice<Sums,I> sums,PtrInt xBegin,PtrInt xEnd,PtrInt height) {
+		if (!xBegin)
+			for (PtrInt j=0; j<=height; ++j)
+				_mm_store_pd( at(sums,0,j), _mm_setzero_pd() );
+		for (PtrInt i=xBegin+1; i<=xEnd; ++i)
+			_mm_store_pd( at(sums,i,0), _mm_setzero_pd() );
+	}
+}
+/** SSE2 version of sumColumns(), the columns are accumulated in pairs
+ *	to have two independent chains of additions */
+template<class I> void sumColumns
+( MatrixSlice< DoubleNum<double>, I > sums, MatrixSlice<float,I> inp, I xBegin, I xEnd, I height ) {
+	using namespace SummerSSE2;
+	ASSERT( sizeof(Sums)==2*sizeof(double) && sums.hasAlignedColumns(16) );
+	zeroEdges(sums,xBegin,xEnd,height);
+	I i= xBegin;
+	for (; i+2<=xEnd; i+=2) {
+		double *col0= at(sums,i+1,1), *col1= at(sums,i+2,1);
+		const float *in0= inp[i], *in1= inp[i+1];
+		__m128d acc0= _mm_setzero_pd(), acc1= _mm_setzero_pd();
+		for (I j=0; j<height; ++j) {
+			acc0= _mm_add_pd( acc0, pixelSums(in0[j]) );
+			acc1= _mm_add_pd( acc1, pixelSums(in1[j]) );
+			_mm_store_pd( col0+2*j, acc0 );
+			_mm_store_pd( col1+2*j, acc1 );
+		}
+	}
+	if (i<xEnd) {
+		double *col= at(sums,i+1,1);
+		const float *in= inp[i];
+		__m128d acc= _mm_setzero_pd();
+		for (I j=0; j<height; ++j) {
+			acc= _mm_add_pd( acc, pixelSums(in[j]) );
+			_mm_store_pd( col+2*j, acc );
+		}
+	}
+}
+/** SSE2 version of sumRows() */
+template<class I>
+void sumRows( MatrixSlice< DoubleNum<double>, I > sums, I width, I yBegin, I yEnd ) {
+	using namespace SummerSSE2;
+	for (I i=2; i<=width; ++i) {
+		double *col= at(sums,i,yBegin+1);
+		const double *prev= at(sums,i-1,yBegin+1);
+		for (I j=0; j<2*(yEnd-yBegin); j+=2)
+			_mm_store_pd( col+j, _mm_add_pd( _mm_load_pd(col+j), _mm_load_pd(prev+j) ) );
+	}
+}
+/** SSE2 version of fillPartialSums(), both the passes are done at once
+ *	(every column is added to the previous one right after it's accumulated)
+ *	and the columns are processed in pairs */
+template<class I> void fillPartialSums
+( MatrixSlice< DoubleNum<double>, I > sums, MatrixSlice<float,I> inp, I width, I height ) {
+	using namespace SummerSSE2;
+	ASSERT( sizeof(Sums)==2*sizeof(double) && sums.hasAlignedColumns(16) );
+	zeroEdges(sums,0,width,height);
+	I i= 0;
+	for (; i+2<=width; i+=2) {
+		const double *prev= at(sums,i,1);
+		double *col0= at(sums,i+1,1), *col1= at(sums,i+2,1);
+		const float *in0= inp[i], *in1= inp[i+1];
+		__m128d acc0= _mm_setzero_pd(), acc1= _mm_setzero_pd();
+		for (I j=0; j<height; ++j) {
+			acc0= _mm_add_pd( acc0, pixelSums(in0[j]) );
+			acc1= _mm_add_pd( acc1, pixelSums(in1[j]) );
+			__m128d sum0= _mm_add_pd( acc0, _mm_load_pd(prev+2*j) );
+			_mm_store_pd( col0+2*j, sum0 );
+			_mm_store_pd( col1+2*j, _mm_add_pd(acc1,sum0) );
+		}
+	}
+	if (i<width) {
+		const double *prev= at(sums,i,1);
+		double *col= at(sums,i+1,1);
+		const float *in= inp[i];
+		__m128d acc= _mm_setzero_pd();
+		for (I j=0; j<height; ++j) {
+			acc= _mm_add_pd( acc, pixelSums(in[j]) );
+			_mm_store_pd( col+2*j, _mm_add_pd( acc, _mm_load_pd(prev+2*j) ) );
+		}
+	}
+}
+#endif
+
+/** A summer of values and squares of pixels taking several times less memory than
+ *	MatrixSummer< DoubleNum<> > (about 4 bytes per pixel instead of 16) for the price
+ *	of slower queries. The sums are computed from the actual pixels as by MatrixSummer,
+ *	only the order of the additions differs. The matrix is split into square tiles
+ *	and the partial sums are stored only on the tile-row and tile-column boundaries,
+ *	the parts of the query rectangles inside the tiles are summed directly from the pixels
+ *	(at most a quarter of a tile for every corner). The pixels mustn't change while
+ *	the summer is used. */
+template<class SumT,class PixT,class I=PtrInt> struct CompactSummer {
+	typedef DoubleNum<SumT> Result;
+	enum {
+		TileLog2=3, TileSize=1<<TileLog2	///< The size of the tiles
+	};
+
+	MatrixSlice<PixT,I> pixels;	///< The summed pixels (shallow copy of the matrix)
+	I width						///  The width of ::pixels
+	, height;					///< The height of ::pixels
+	/** The sums of all the pixels to the left and up of the corners on the tile-row
+	 *	boundaries - [x][ty] is for the corner [x][ty*TileSize] */
+	MatrixSlice<Result,I> rowSums;
+	/** The same as #rowSums for the corners on the tile-column boundaries,
+	 *	[tx][y] is for the corner [tx*TileSize][y] */
+	MatrixSlice<Result,I> colSums;
+
+	/** Returns whether the object is filled with data */
+	bool isValid()	const	{ return rowSums.isValid(); }
+	/** Clears the object */
+	void free()	{
+		rowSums.free();
+		colSums.free();
+		pixels.start= 0;
+	}
+
+	/** Computes the sums of a rectangle (in time proportional to the tile size) */
+	Result getSum(I x0,I y0,I xend,I yend) const {
+		ASSERT( isValid() );
+		return getCornerSum(xend,yend) - (getCornerSum(x0,yend) + getCornerSum(xend,y0))
+			+ getCornerSum(x0,y0);
+	}
+	/** A shortcut to get the sums of a block */
+	Result getSum(const Block &b) const
+		{ return getSum( b.x0, b.y0, b.xend, b.yend ); }
+
+	/** Prepares object to make sums for a matrix. If the summer has already been
+	 *	used before, the method assumes it was for a matrix of the same size */
+	void fill(MatrixSlice<PixT,I> inp,I width_,I height_) {
+		pixels= inp;
+		width= width_;
+		height= height_;
+		const I tileRows= (height>>TileLog2) + 1;
+		if ( !isValid() ) {
+			rowSums.allocate( width+1, tileRows );
+			colSums.allocate( (width>>TileLog2) + 1, height+1 );
+		}
+	//	sweep the columns, keeping the sums of all the pixels to the left and up
+	//	of the current column of corners
+		std::vector<Result> corners( height+1, Result(0) );
+		for (I x=0; ; ++x) {
+		//	store the boundary sums of the current column of corners
+			for (I ty=0; ty<tileRows; ++ty)
+				rowSums[x][ty]= corners[ty<<TileLog2];
+			if ( x%TileSize == 0 )
+				std::copy( corners.begin(), corners.end(), colSums[x>>TileLog2] );
+			if (x==width)
+				break;
+		//	add the pixel column to the corners
+			Result column(0);
+			for (I y=0; y<height; ++y) {
+				column+= Result(inp[x][y]);
+				corners[y+1]+= column;
+			}
+		}
+	}
+protected:
+	/** Returns the sums of all the pixels to the left and up of the corner [\p x][\p y] */
+	Result getCornerSum(I x,I y) const {
+	//	find the nearest corner on both the tile boundaries (bx,by),
+	//	the sums for the corners [bx][y], [x][by] and [bx][by] are stored
+		I bx= nearestBoundary(x,width), by= nearestBoundary(y,height);
+		Result result= colSums[bx>>TileLog2][y] + rowSums[x][by>>TileLog2]
+			- rowSums[bx][by>>TileLog2];
+	//	add or subtract the pixels between the two corners
+		if ( x==bx || y==by )
+			return result;
+		Result inner(0);
+		for (I i=std::min(x,bx), iend=std::max(x,bx); i<iend; ++i)
+			for (I j=std::min(y,by), jend=std::max(y,by); j<jend; ++j)
+				inner+= Result(pixels[i][j]);
+		if ( (x<bx) == (y<by) )
+			result+= inner;
+		else
+			result-= inner;
+		return result;
+	}
+	/** Returns the tile boundary nearest to \p pos (not exceeding \p size) */
+	static I nearestBoundary(I pos,I size) {
+		I lower= pos & ~I(TileSize-1), upper= lower+TileSize;
+		return pos-lower <= upper-pos || upper>size ? lower : upper;
+	}
+}; // CompactSummer class template
+
 /** Structure for a block of pixels - also contains summers and dimensions */
 template< class SumT, class PixT, class I=PtrInt >
 struct SummedMatrix {
 	typedef DoubleNum<SumT> BSumRes;
 	typedef MatrixSummer<BSumRes,I> BSummer;
+	typedef CompactSummer<SumT,PixT,I> CSummer;
 	
 	I width						///  The width of ::pixels
 	, height;					///< The height of ::pixels
 	MatrixSlice<PixT> pixels;	///< The matrix of pixels
 	BSummer summer;				///< Summer for values and squares of ::pixels
-	bool sumsValid;				///< Indicates whether the summer values are valid
+	CSummer compactSummer;		///< Summer used instead of ::summer if ::compactSums is set
+	bool sumsValid				///  Indicates whether the summer values are valid
+	, compactSums;				///< Indicates whether to use ::compactSummer (less memory)
+	Block sumsRegion;			///< Only the sums of blocks within it are valid (if ::sumsValid)
 	
+	/** Only initializes the flags (no compact summer) */
+	SummedMatrix()
+	: sumsValid(false), compactSums(false) {}
+
 	/** Sets the size of ::pixels, optionally allocates memory */
 	void setSize( I width_, I height_ ) {
 		free();
 		width= width_;
 		height= height_;
-		pixels.allocate(width,height);
+		pixels.allocateAligned(width,height);
 	}
 	/** Frees the memory */
 	void free(bool freePixels=true) {
@@ -209,15 +500,21 @@ struct SummedMatrix {
 		else
 			pixels.start= 0;
 		summer.free();
+		compactSummer.free();
 		sumsValid= false;
 	}
 	
-	/** Just validates both summers (if needed) */
+	/** Just validates both summers for the whole matrix (if needed) */
 	void summers_makeValid() const {
 		ASSERT(pixels.isValid());
-		if (!sumsValid) {
-			constCast(summer).fill(pixels,width,height);
+		Block whole(0,0,width,height);
+		if ( !sumsValid || !sumsRegion.contains(whole) ) {
+			if (compactSums)
+				constCast(compactSummer).fill(pixels,width,height);
+			else
+				constCast(summer).fill(pixels,width,height);
 			constCast(sumsValid)= true;
+			constCast(sumsRegion)= whole;
 		}
 	}
 	/** Justs invalidates both summers (to be called after changes in the pixel-matrix) */
@@ -229,8 +526,9 @@ struct SummedMatrix {
 	/** Gets both sums of a nonempty rectangle in ::pixels, the summer isn't validated */
 	BSumRes getSums( I x0, I y0, I xend, I yend ) const {
 		ASSERT( sumsValid && x0>=0 && y0>=0 && xend>x0 && yend>y0 
-			&& xend<=width && yend<=height );
-		return summer.getSum(x0,y0,xend,yend);
+			&& xend<=width && yend<=height && sumsRegion.contains(Block(x0,y0,xend,yend)) );
+		return compactSums ? compactSummer.getSum(x0,y0,xend,yend)
+			: summer.getSum(x0,y0,xend,yend);
 	}
 	/** Gets only the sum of values (not the sum of squares) */
 	SumT getValueSum( I x0, I y0, I xend, I yend ) const {
@@ -520,6 +818,193 @@ namespace MatrixWalkers {
 		template<class R1,class R2> void operator()(R1 &res,R2 f) const
 			{ res= checkBoundsFunc( min, f*toMul+toAdd, max ); }
 	};
+
+	/** The same as MulAddCopyChecked, but it also accumulates
+	 *	the sum of squared changes of the results in ::delta2 */
+	template<class T> struct MulAddCopyCheckedDelta: public MulAddCopyChecked<T> {
+		T delta2;
+
+		MulAddCopyCheckedDelta(T mul,T add,T minVal,T maxVal)
+		: MulAddCopyChecked<T>(mul,add,minVal,maxVal), delta2(0) {}
+
+		template<class R1,class R2> void operator()(R1 &res,R2 f) {
+			T old= res;
+			MulAddCopyChecked<T>::operator()(res,f);
+			delta2+= sqr(res-old);
+		}
+	};
+
+#ifdef __SSE2__
+/**	\name SSE2 specializations of walkOperate()
+ *	For float matrices walked by columns on both sides (the rotations stepping by +-1
+ *	in the inner loop) the common operators are vectorized along the columns.
+ *	The checked matrix is accessed by aligned operations if its block permits it.
+ *	@{ */
+	/** Calls \p column(checkedColumn,uncheckedColumn,height) for all columns of the block
+	 *	of \p checked and the corresponding (contiguous) lines of \p unchecked */
+	template<class T,class U,class I,class Column>
+	inline void walkColumns( Checked<T,I> checked, U unchecked, Column &column ) {
+		const I height= checked.colEnd - checked.lastStart;
+		ASSERT( checked.outerCond() && height>0 );
+		do {
+			checked.innerInit();
+			unchecked.innerInit();
+			column( checked.current.start, unchecked.current.start, height );
+			checked.outerStep();
+			unchecked.outerStep();
+		} while ( checked.outerCond() );
+	}
+	/** Returns whether the columns of \p checked begin on 16-byte boundaries */
+	template<class T,class I> inline bool hasAlignedColumns(const Checked<T,I> &checked) {
+		return (PtrInt)checked.lastStart % 16 == 0 && checked.current.colSkip % 4 == 0;
+	}
+
+	/** Loads four floats from \p p, aligned if \p Aligned */
+	template<bool Aligned> inline __m128 loadPs(const float *p)
+		{ return Aligned ? _mm_load_ps(p) : _mm_loadu_ps(p); }
+	/** Stores four floats to \p p, aligned if \p Aligned */
+	template<bool Aligned> inline void storePs(float *p,__m128 v)
+		{ if (Aligned) _mm_store_ps(p,v); else _mm_storeu_ps(p,v); }
+	/** Loads four floats from \p p on, or down from \p p reversed if \p Reversed
+	 *	(then the first returned value is on \p p) */
+	template<bool Reversed> inline __m128 loadLine(const float *p) {
+		return Reversed
+			? _mm_shuffle_ps( _mm_loadu_ps(p-3), _mm_loadu_ps(p-3), _MM_SHUFFLE(0,1,2,3) )
+			: _mm_loadu_ps(p);
+	}
+	/** The number of floats to move by to get to the next four ones */
+	template<bool Reversed> inline PtrInt lineStep()
+		{ return Reversed ? -4 : 4; }
+
+	/** Column kernel of RDSummer, sums the products in double precision */
+	template<bool Aligned,bool Reversed> struct RDSummerColumn {
+		__m128d acc; ///< the sums of products in two halves
+		RDSummerColumn(): acc(_mm_setzero_pd()) {}
+
+		void operator()( const float *a, const float *b, PtrInt height ) {
+			PtrInt j= 0;
+			for (; j+4<=height; j+=4, a+=4, b+=lineStep<Reversed>()) {
+				__m128 va= loadPs<Aligned>(a), vb= loadLine<Reversed>(b);
+				acc= _mm_add_pd( acc, _mm_mul_pd( _mm_cvtps_pd(va), _mm_cvtps_pd(vb) ) );
+				acc= _mm_add_pd( acc, _mm_mul_pd( _mm_cvtps_pd(_mm_movehl_ps(va,va))
+					, _mm_cvtps_pd(_mm_movehl_ps(vb,vb)) ) );
+			}
+			double rest= 0;
+			for (; j<height; ++j, ++a, Reversed ? --b : ++b)
+				rest+= double(*a) * double(*b);
+			acc= _mm_add_sd( acc, _mm_set_sd(rest) );
+		}
+		double result() const {
+			double halves[2];
+			_mm_storeu_pd(halves,acc);
+			return halves[0]+halves[1];
+		}
+	};
+	/** Column kernel of MulAddCopyChecked and MulAddCopyCheckedDelta (if \p Delta),
+	 *	computes in double precision like the operators */
+	template<bool Aligned,bool Reversed,bool Delta> struct MulAddColumn {
+		const __m128d mul, add, min, max;
+		__m128d delta2; ///< the sums of squared changes in two halves (if \p Delta)
+		double restDelta2;
+
+		MulAddColumn( const MulAddCopyChecked<double> &oper )
+		: mul(_mm_set1_pd(oper.toMul)), add(_mm_set1_pd(oper.toAdd))
+		, min(_mm_set1_pd(oper.min)), max(_mm_set1_pd(oper.max))
+		, delta2(_mm_setzero_pd()), restDelta2(0) {}
+
+		/** Maps two values and returns them as floats in the lower half */
+		__m128 map(__m128 v) const {
+			return _mm_cvtpd_ps( _mm_min_pd( _mm_max_pd
+				( _mm_add_pd( _mm_mul_pd(_mm_cvtps_pd(v),mul), add ), min ), max ) );
+		}
+		void operator()( float *res, const float *f, PtrInt height ) {
+			PtrInt j= 0;
+			for (; j+4<=height; j+=4, res+=4, f+=lineStep<Reversed>()) {
+				__m128 v= loadLine<Reversed>(f);
+				__m128 mapped= _mm_movelh_ps( map(v), map(_mm_movehl_ps(v,v)) );
+				if (Delta) {
+					__m128 old= loadPs<Aligned>(res);
+					__m128d dLo= _mm_sub_pd( _mm_cvtps_pd(mapped), _mm_cvtps_pd(old) )
+					, dHi= _mm_sub_pd( _mm_cvtps_pd(_mm_movehl_ps(mapped,mapped))
+						, _mm_cvtps_pd(_mm_movehl_ps(old,old)) );
+					delta2= _mm_add_pd( delta2, _mm_add_pd( _mm_mul_pd(dLo,dLo)
+						, _mm_mul_pd(dHi,dHi) ) );
+				}
+				storePs<Aligned>(res,mapped);
+			}
+			for (; j<height; ++j, ++res, Reversed ? --f : ++f) {
+				float mapped= checkBoundsFunc( minD(), *f*mulD()+addD(), maxD() );
+				if (Delta)
+					restDelta2+= sqr( double(mapped)-double(*res) );
+				*res= mapped;
+			}
+		}
+		double getDelta2() const {
+			double halves[2];
+			_mm_storeu_pd(halves,delta2);
+			return halves[0]+halves[1]+restDelta2;
+		}
+	private:
+		double mulD() const { return _mm_cvtsd_f64(mul); }
+		double addD() const { return _mm_cvtsd_f64(add); }
+		double minD() const { return _mm_cvtsd_f64(min); }
+		double maxD() const { return _mm_cvtsd_f64(max); }
+	};
+
+	/** Runs a column kernel \p Kernel<Aligned,Reversed> over \p checked and \p unchecked */
+	template<bool Reversed,class T,class U,class I>
+	inline double walkRDSum( Checked<T,I> checked, U unchecked ) {
+		if ( hasAlignedColumns(checked) ) {
+			RDSummerColumn<true,Reversed> column;
+			walkColumns( checked, unchecked, column );
+			return column.result();
+		} else {
+			RDSummerColumn<false,Reversed> column;
+			walkColumns( checked, unchecked, column );
+			return column.result();
+		}
+	}
+	template<bool Reversed,bool Delta,class I,class U>
+	inline double walkMulAdd
+	( Checked<float,I> checked, U unchecked, const MulAddCopyChecked<double> &oper ) {
+		if ( hasAlignedColumns(checked) ) {
+			MulAddColumn<true,Reversed,Delta> column(oper);
+			walkColumns( checked, unchecked, column );
+			return column.getDelta2();
+		} else {
+			MulAddColumn<false,Reversed,Delta> column(oper);
+			walkColumns( checked, unchecked, column );
+			return column.getDelta2();
+		}
+	}
+
+	/** Defines the specializations of walkOperate() for the walker \p ROT */
+	#define MATRIXWALKERS_SSE2_WALKOPERATE(ROT,REVERSED) \
+		template<class I> inline RDSummer<double,float> walkOperate \
+		( Checked<const float,I> checked, ROT<float,I> unchecked, RDSummer<double,float> oper ) { \
+			ASSERT( !oper.lineSum ); \
+			oper.totalSum+= walkRDSum<REVERSED>(checked,unchecked); \
+			return oper; \
+		} \
+		template<class I> inline MulAddCopyChecked<double> walkOperate \
+		( Checked<float,I> checked, ROT<float,I> unchecked \
+		, MulAddCopyChecked<double> oper ) { \
+			walkMulAdd<REVERSED,false>(checked,unchecked,oper); \
+			return oper; \
+		} \
+		template<class I> inline MulAddCopyCheckedDelta<double> walkOperate \
+		( Checked<float,I> checked, ROT<float,I> unchecked \
+		, MulAddCopyCheckedDelta<double> oper ) { \
+			oper.delta2+= walkMulAdd<REVERSED,true>(checked,unchecked,oper); \
+			return oper; \
+		}
+	MATRIXWALKERS_SSE2_WALKOPERATE(Rotation_0,false)
+	MATRIXWALKERS_SSE2_WALKOPERATE(Rotation_1_T,false)
+	MATRIXWALKERS_SSE2_WALKOPERATE(Rotation_2,true)
+	MATRIXWALKERS_SSE2_WALKOPERATE(Rotation_3_T,true)
+	#undef MATRIXWALKERS_SSE2_WALKOPERATE
+///	@}
+#endif // __SSE2__
 } // MatrixWalkers namespace
 
 #endif // MATRIXUTIL_HEADER_
@@ -0,0 +1,210 @@
+#include "classPredictor.h"
+using namespace std;
+
+namespace NOSPACE {
+	/** The quadrants of a block are indexed by 2*qx+qy (qx,qy = 0 or 1, column-major).
+	 *	For every rotation: the range quadrant that gets the domain's quadrant
+	 *	(the same convention as MatrixWalkers::walkOperateCheckRotate) */
+	const unsigned char rotatedQuadrants[8][4]= {
+		{0,1,2,3}, {0,2,1,3}, {1,3,0,2}, {2,3,0,1},
+		{3,2,1,0}, {3,1,2,0}, {2,0,3,1}, {1,0,3,2}
+	};
+
+	/** Computes the means and the variances of the four quadrants of a \p block
+	 *	(at least 2x2) of \p pixels, the unequal halves are allowed */
+	void getQuadrantStats
+	( const SummedPixels &pixels, const Block &block, Real means[4], Real vars[4] ) {
+		ASSERT( block.width()>=2 && block.height()>=2 );
+		int xs[3]= { block.x0, block.x0+block.width()/2, block.xend }
+		, ys[3]= { block.y0, block.y0+block.height()/2, block.yend };
+		for (int qx=0; qx<2; ++qx)
+			for (int qy=0; qy<2; ++qy) {
+				int q= 2*qx+qy;
+				Real sum, sum2, count= (xs[qx+1]-xs[qx]) * (ys[qy+1]-ys[qy]);
+				pixels.getSums( xs[qx], ys[qy], xs[qx+1], ys[qy+1] ).unpack(sum,sum2);
+				means[q]= sum/count;
+				vars[q]= sum2/count - sqr(means[q]);
+			}
+	}
+
+	/** Computes the ranks of four \p values in descending order (ties by the indices) */
+	void getRanks( const Real values[4], char ranks[4] ) {
+		for (int i=0; i<4; ++i) {
+			ranks[i]= 0;
+			for (int j=0; j<4; ++j)
+				ranks[i]+= values[j]>values[i] || ( values[j]==values[i] && j<i );
+		}
+	}
+
+	/** Returns the index of the ordering given by \p ranks (0 to 23, a Lehmer code) */
+	int getOrderingIndex( const char ranks[4] ) {
+		int result= 0;
+		for (int i=0; i<3; ++i) {
+			int smaller= 0;
+			for (int j=i+1; j<4; ++j)
+				smaller+= ranks[j]<ranks[i];
+			result= result*(4-i) + smaller;
+		}
+		return result;
+	}
+
+	/** Returns the orderings differing from \p ranks by a swap of neighbouring ranks */
+	void getNeighbourOrderings( const char ranks[4], int neighbours[3] ) {
+		for (int rank=0; rank<3; ++rank) {
+			char swapped[4];
+			for (int i=0; i<4; ++i)
+				swapped[i]= ranks[i]==rank ? rank+1 : ( ranks[i]==rank+1 ? rank : ranks[i] );
+			neighbours[rank]= getOrderingIndex(swapped);
+		}
+	}
+}
+
+void MClassPredictor::prepare( const ISquareDomains::PoolList &pools
+, const ISquareEncoder::LevelPoolInfos &levelPoolInfos, int minLevel, int maxLevel, bool ) {
+	ASSERT( levelClasses.empty() && minLevel>=0 );
+	int levelCount= levelPoolInfos.size();
+	levelClasses.resize( levelCount, (LevelClasses*)0 );
+//	classify the domains for the used levels with some domains (cheap, no need of tasks)
+	for (int level=minLevel; level<=maxLevel && level<levelCount; ++level) {
+		const PoolInfos &poolInfos= levelPoolInfos[level];
+		if ( !poolInfos.empty() && poolInfos.back().indexBegin>0 )
+			levelClasses[level]= createClasses( pools, poolInfos, level );
+	}
+}
+
+IStdEncPredictor::IOneRangePredictor* MClassPredictor
+::newPredictor(const NewPredictorData &data) {
+	const ISquareRanges::RangeNode &rb= *data.rangeBlock;
+	int level= rb.level;
+	LevelClasses *classes;
+	{//	the classes can be requested concurrently -> lock them
+		QMutexLocker locker(&levelClassesMutex);
+		if ( level >= (int)levelClasses.size() )
+			levelClasses.resize( level+1, (LevelClasses*)0 );
+		classes= levelClasses[level];
+		if (!classes)
+			classes= levelClasses[level]= createClasses( *data.pools, *data.poolInfos, level );
+	//	the debugging stats are also shared by concurrent predictors
+		DEBUG_ONLY( maxpred+= classes->predictions.size()/(data.allowRotations?1:8)
+			*(data.allowInversion?2:1); )
+	}
+	ASSERT(classes);
+	OneRangePredictor *result= new OneRangePredictor( *classes, data.allowRotations );
+	#ifndef NDEBUG
+		result->owner= this;
+		result->predicted= 0;
+	#endif
+	if ( rb.width()<2 || rb.height()<2 )
+		return result; // can't be split into quadrants, nothing to predict
+//	classify the range block
+	Real means[4], vars[4];
+	getQuadrantStats( *data.rangePixels, rb, means, vars );
+	char meanRanks[4], varRanks[4]= {0,1,2,3};
+	getRanks(means,meanRanks);
+	bool useVariance= settingsInt(VarianceSubclasses);
+	if (useVariance)
+		getRanks(vars,varRanks);
+	int meanOrd= getOrderingIndex(meanRanks), varOrd= getOrderingIndex(varRanks);
+//	the inverted mappings reverse the order of means (the order of variances is kept)
+	int inversions= data.allowInversion ? 2 : 1;
+	for (int inv=0; inv<inversions; ++inv) {
+		if (inv) {
+			for (int i=0; i<4; ++i)
+				meanRanks[i]= 3-meanRanks[i];
+			meanOrd= getOrderingIndex(meanRanks);
+		}
+		int *list= result->classList;
+		int &count= result->classCount;
+		list[count++]= meanOrd*OrderingCount + varOrd;
+		if ( !settingsInt(NeighbourClasses) )
+			continue;
+		int neighbours[3];
+		getNeighbourOrderings(meanRanks,neighbours);
+		for (int i=0; i<3; ++i)
+			list[count++]= neighbours[i]*OrderingCount + varOrd;
+		if (!useVariance)
+			continue;
+		getNeighbourOrderings(varRanks,neighbours);
+		for (int i=0; i<3; ++i)
+			list[count++]= meanOrd*OrderingCount + neighbours[i];
+	}
+	ASSERT( result->classCount <= OneRangePredictor::MaxClasses );
+	return result;
+}
+
+MClassPredictor::LevelClasses* MClassPredictor::createClasses
+( const ISquareDomains::PoolList &pools, const PoolInfos &poolInfos, int level ) {
+	const int domainCount= poolInfos.back().indexBegin
+	, side= powers[level];
+	bool useVariance= settingsInt(VarianceSubclasses);
+//	classify every domain in every rotation (the same order of IDs as in MStdEncoder)
+	vector<short> domClasses(8*domainCount);
+	vector<short>::iterator classIt= domClasses.begin();
+	int poolCount= pools.size();
+	for (int poolID=0; poolID<poolCount; ++poolID) {
+		const ISquareDomains::Pool &pool= pools[poolID];
+		int density= poolInfos[poolID].density;
+		if (!density) // no domains in this pool for this level
+			continue;
+		int poolXend= density*getCountForDensity( pool.width, density, side )
+		, poolYend= density*getCountForDensity( pool.height, density, side );
+		for (int x0=0; x0<poolXend; x0+=density)
+			for (int y0=0; y0<poolYend; y0+=density) {
+				Real means[4], vars[4];
+				getQuadrantStats( pool, Block(x0,y0,x0+side,y0+side), means, vars );
+				for (int rot=0; rot<8; ++rot) {
+				//	arrange the quadrants as they are mapped onto the range block
+					Real rotMeans[4], rotVars[4];
+					for (int q=0; q<4; ++q) {
+						rotMeans[ rotatedQuadrants[rot][q] ]= means[q];
+						rotVars[ rotatedQuadrants[rot][q] ]= vars[q];
+					}
+					char ranks[4];
+					getRanks(rotMeans,ranks);
+					int cls= getOrderingIndex(ranks)*OrderingCount;
+					if (useVariance) {
+						getRanks(rotVars,ranks);
+						cls+= getOrderingIndex(ranks);
+					}
+					*classIt++= cls;
+				}
+			}
+	}
+	ASSERT( classIt==domClasses.end() );
+//	sort the predictions by their classes (counting sort, keeps domains ordered by IDs)
+	LevelClasses *result= new LevelClasses;
+	vector<int> &begins= result->classBegins;
+	begins.assign(ClassCount+1,0);
+	for (classIt=domClasses.begin(); classIt!=domClasses.end(); ++classIt)
+		++begins[*classIt+1];
+	for (int cls=0; cls<ClassCount; ++cls)
+		begins[cls+1]+= begins[cls];
+	vector<int> positions( begins.begin(), begins.end()-1 );
+	result->predictions.resize( domClasses.size() );
+	for (int i=0; i<(int)domClasses.size(); ++i)
+		result->predictions[ positions[domClasses[i]]++ ]= Prediction( i/8, i%8 );
+	return result;
+}
+
+MClassPredictor::Predictions& MClassPredictor::OneRangePredictor
+::getChunk(float /*maxPredictedSE*/,Predictions &store) {
+	store.clear();
+//	return the next nonempty class
+	while ( store.empty() && nextClass<classCount ) {
+		int cls= classList[nextClass++];
+		Predictions::const_iterator it= classes.predictions.begin()+classes.classBegins[cls]
+		, itEnd= classes.predictions.begin()+classes.classBegins[cls+1];
+		if (allowRotations)
+			store.assign(it,itEnd);
+		else
+			for (; it!=itEnd; ++it)
+				if (it->rotation==0)
+					store.push_back(*it);
+	}
+
+	#ifndef NDEBUG
+	predicted+= store.size();
+	#endif
+
+	return store;
+}
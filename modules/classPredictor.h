@@ -0,0 +1,116 @@
+#ifndef CLASSPREDICTOR_HEADER_
+#define CLASSPREDICTOR_HEADER_
+
+#include "../headers.h"
+
+#include <QMutex>
+
+/// \ingroup modules
+/** Predictor for MStdEncoder based on the classification by Fisher and Jacquin.
+ *	Every block is split into quadrants and classified by the ordering of quadrant means
+ *	(and optionally also of quadrant variances). The domains are classified in all
+ *	rotations in advance and a range block is only compared with the domains
+ *	that fall into its class (optionally also into the neighbouring classes)
+ *	in some rotation. The inverted mappings have the reversed ordering of means. */
+class MClassPredictor: public IStdEncPredictor {
+	DECLARE_debugModule;
+
+	DECLARE_TypeInfo( MClassPredictor, "Classification predictor"
+	, "Predictor for standard encoder comparing only blocks of the same class"
+	, {
+		label:	"Variance subclasses",
+		desc:	"Divide the classes given by the ordering of quadrant means\n"
+				"according to the ordering of quadrant variances",
+		type:	settingCombo("no\nyes",1)
+	}, {
+		label:	"Neighbouring classes",
+		desc:	"Predict also the domains from the classes whose ordering\n"
+				"only differs by swapping two neighbouring quadrants",
+		type:	settingCombo("no\nyes",0)
+	} )
+
+protected:
+	/** Indices for settings */
+	enum Settings { VarianceSubclasses, NeighbourClasses };
+	/** The number of orderings of four quadrants and the number of all classes */
+	enum { OrderingCount=4*3*2, ClassCount=OrderingCount*OrderingCount };
+
+public:
+	typedef ISquareEncoder::LevelPoolInfos::value_type PoolInfos;
+protected:
+	/** The classified domains for one level */
+	struct LevelClasses {
+		std::vector<int> classBegins;	///< The beginning of every class in #predictions (and the end)
+		Predictions predictions;		///< All the domains in all rotations sorted by their classes
+	};
+
+//	Module's data
+	std::vector<LevelClasses*> levelClasses;///< The classes for every level (can be missing)
+	QMutex levelClassesMutex;	///< The lock for #levelClasses (they can be built on demand)
+	#ifndef NDEBUG // the stats about the domain counts predicted
+	long predicted, maxpred;
+	#endif
+
+protected:
+//	Construction and destruction
+	#ifndef NDEBUG
+	MClassPredictor(): predicted(0), maxpred(0) {}
+	#endif
+	/** Only call ::cleanUp */
+	~MClassPredictor() { cleanUp(); }
+
+public:
+/**	\name IStdEncPredictor interface
+ *	@{ */
+	void prepare( const ISquareDomains::PoolList &pools
+	, const ISquareEncoder::LevelPoolInfos &levelPoolInfos, int minLevel, int maxLevel
+	, bool allowInversion );
+	IOneRangePredictor* newPredictor(const NewPredictorData &data);
+
+	void cleanUp() {
+		clearContainer(levelClasses);
+		levelClasses.clear();
+	}
+///	@}
+
+protected:
+	/** Classifies all the domains in all rotations for range blocks on \p level */
+	LevelClasses* createClasses
+	( const ISquareDomains::PoolList &pools, const PoolInfos &poolInfos, int level );
+
+protected:
+	/** Implementation of the one-range-predictor from IStdEncPredictor interface
+	 *	- returns the range's own class as the first chunk, then the other classes one by one */
+	class OneRangePredictor: public IOneRangePredictor {
+		friend class MClassPredictor;
+		enum { MaxClasses=2*7 }; ///< own and 6 neighbouring classes, possibly inverted
+
+		const LevelClasses &classes;///< The classified domains of the range's level
+		int classList[MaxClasses]	///  The classes to return
+		, classCount				///  The number of valid items in #classList
+		, nextClass;				///< The index of the next class to return
+		bool allowRotations;		///< Whether the rotations are allowed
+	#ifndef NDEBUG // the stats are added to the owner's ones on destruction
+		MClassPredictor *owner;
+		long predicted;
+	#endif
+
+		/** Only initializes the members, #classList is filled by MClassPredictor */
+		OneRangePredictor(const LevelClasses &classes_,bool allowRotations_)
+		: classes(classes_), classCount(0), nextClass(0), allowRotations(allowRotations_) {}
+	public:
+	/**	\name IOneRangePredictor interface
+	 *	@{ */
+		Predictions& getChunk(float maxPredictedSE,Predictions &store);
+	///	@}
+	#ifndef NDEBUG
+		~OneRangePredictor() {
+			QMutexLocker locker(&owner->levelClassesMutex);
+			owner->predicted+= predicted;
+		}
+	#endif
+	}; // MClassPredictor::OneRangePredictor class
+
+}; // MClassPredictor class
+
+#endif // CLASSPREDICTOR_HEADER_
@@ -71,7 +71,7 @@ MColorModel::PlaneList MColorModel
 //	create the plane list	
 	PlaneList result(planeCount);
 	for (int i=0; i<planeCount; ++i) {
-		result[i].pixels.allocate( prototype.width, prototype.height );
+		result[i].pixels.allocateAligned( prototype.width, prototype.height );
 		PlaneSettings *newSet= new PlaneSettings(prototype);
 		newSet->quality*= qualityMul(i);
 		result[i].settings= newSet;
@@ -0,0 +1,218 @@
+#include "fftPredictor.h"
+using namespace std;
+
+namespace NOSPACE {
+	using FFT::Complex;
+
+	/** The estimated cost of an FFT butterfly relative to a multiply-add of two pixels */
+	const int FFTCostFactor= 4;
+
+	/** For every rotation: the index of the range layout (as it is, with reversed columns,
+	 *	transposed, transposed with reversed columns) and whether the domain's column x
+	 *	is mapped to the column n-1-x (the same convention as in MStdEncoder) */
+	const struct { char layout; bool mirrored; } rotationColumns[8]= {
+		{0,false}, {2,false}, {2,true}, {0,true}, {1,true}, {3,true}, {3,false}, {1,false}
+	};
+
+	/** Returns the pixel of the \p n x \p n \p range block that is multiplied
+	 *	by the pixel [\p x,\p y] of a domain in \p rotation */
+	inline Real rotatedPixel( const SummedPixels &pixels, const Block &range, int n
+	, int rotation, int x, int y ) {
+		int col= rotationColumns[rotation].mirrored ? n-1-x : x, rx, ry;
+		switch (rotationColumns[rotation].layout) {
+			case 0:	rx= col;	ry= y;		break;
+			case 1:	rx= col;	ry= n-1-y;	break;
+			case 2:	rx= y;		ry= col;	break;
+			default:rx= n-1-y;	ry= col;
+		}
+		return pixels.pixels[range.x0+rx][range.y0+ry];
+	}
+
+	/** Returns the number of trailing zero bits of a positive \p i */
+	inline int trailingZeros(int i) {
+		ASSERT(i>0);
+		int result= 0;
+		for (; !(i&1); i>>=1)
+			++result;
+		return result;
+	}
+
+	/** Returns the cost of a 2D FFT of 2^\p log2n elements */
+	inline double fftCost(int log2n)
+		{ return double(FFTCostFactor) * powers[log2n] * log2n; }
+}
+
+const MFFTPredictor::PoolTransform& MFFTPredictor::getPoolTransform
+( const ISquareDomains::PoolList &pools, int poolID ) {
+//	the transforms can be requested concurrently -> lock them
+	QMutexLocker locker(&poolTransformsMutex);
+	if ( poolID >= (int)poolTransforms.size() )
+		poolTransforms.resize( poolID+1, (PoolTransform*)0 );
+	PoolTransform *&result= poolTransforms[poolID];
+	if (result)
+		return *result;
+//	copy the pool's pixels into the zero-padded matrix and transform it
+	const ISquareDomains::Pool &pool= pools[poolID];
+	result= new PoolTransform;
+	result->log2w= log2ceil(pool.width);
+	result->log2h= log2ceil(pool.height);
+	int height= powers[result->log2h];
+	result->data.resize( powers[result->log2w+result->log2h] );
+	for (int x=0; x<pool.width; ++x)
+		for (int y=0; y<pool.height; ++y)
+			result->data[x*height+y]= pool.pixels[x][y];
+	FFT::transform2D( &result->data[0], result->log2w, result->log2h, false );
+	return *result;
+}
+
+bool MFFTPredictor::fftPaysOff(const NewPredictorData &data) {
+	const ISquareDomains::PoolList &pools= *data.pools;
+	const PoolInfos &poolInfos= *data.poolInfos;
+	int side= powers[data.rangeBlock->level]
+	, rotations= data.allowRotations ? 8 : 1;
+//	compare the cost of direct products with the cost of the transforms for all the pools
+	double directCost= double(poolInfos.back().indexBegin) * rotations * sqr(side)
+	, transformCost= 0;
+	for (int poolID=0; poolID<(int)pools.size(); ++poolID) {
+		int density= poolInfos[poolID].density;
+		if (!density)
+			continue;
+		int log2n= log2ceil(pools[poolID].width) + log2ceil(pools[poolID].height)
+		, fold= min( trailingZeros(density), min( log2ceil(pools[poolID].width)
+			, log2ceil(pools[poolID].height) ) );
+		transformCost+= (rotations+1)/2 * ( fftCost(log2n) + fftCost(log2n-2*fold) );
+	}
+	return transformCost < directCost;
+}
+
+IStdEncPredictor::IOneRangePredictor* MFFTPredictor
+::newPredictor(const NewPredictorData &data) {
+	bool useFFT= data.isRegular && ( settingsInt(AlwaysFFT) || fftPaysOff(data) );
+	return new OneRangePredictor( *this, data, settingsInt(ChunkSize), useFFT );
+}
+
+void MFFTPredictor::OneRangePredictor::computeCandidates(float maxSE) {
+	ASSERT( candidates.empty() );
+	for (int poolID=0; poolID<(int)data.pools->size(); ++poolID)
+		if ( (*data.poolInfos)[poolID].density )
+			addPoolCandidates(poolID,maxSE);
+	make_heap( candidates.begin(), candidates.end() );
+}
+
+void MFFTPredictor::OneRangePredictor::addPoolCandidates(int poolID,float maxSE) {
+	const ISquareDomains::Pool &pool= (*data.pools)[poolID];
+	const PoolTransform &poolTrans= owner.getPoolTransform(*data.pools,poolID);
+	const Block &range= *data.rangeBlock;
+	int n= range.width()
+	, density= (*data.poolInfos)[poolID].density
+	, idBegin= (*data.poolInfos)[poolID].indexBegin
+	, domsInCol= getCountForDensity( pool.height, density, n )
+	, domsInRow= getCountForDensity( pool.width, density, n )
+	, rotations= data.allowRotations ? 8 : 1
+	, log2w= poolTrans.log2w, log2h= poolTrans.log2h
+	, width= powers[log2w], height= powers[log2h];
+	ASSERT( range.height()==n && n<=pool.width && n<=pool.height );
+//	the correlations are only needed on the lattice of domains -> the spectrum is folded
+//	by the power-of-two part of the density and the sampling continues by the rest
+	int fold= min( trailingZeros(density), min(log2w,log2h) )
+	, fHeight= powers[log2h-fold], fWidth= powers[log2w-fold]
+	, step= density >> fold;
+	Real scale= ldexp( Real(1), -log2w-log2h ); // normalizes the inverse transform
+
+//	compute the error denominators of the domains (zero marks rejected ones)
+	int domCount= domsInRow*domsInCol;
+	vector<Real> dSums(domCount), sqrtDenoms(domCount);
+	for (int i=0; i<domsInRow; ++i)
+		for (int j=0; j<domsInCol; ++j) {
+			int id= i*domsInCol+j, x0= i*density, y0= j*density;
+			Real d2Sum;
+			pool.getSums( x0, y0, x0+n, y0+n ).unpack( dSums[id], d2Sum );
+			Real test= data.pixCount*d2Sum - sqr(dSums[id]);
+			Real denom= test>0 ? 1/test : 0; // skip too flat domains
+			if ( data.maxLinCoeff2>=0 && data.rnDev2*denom > data.maxLinCoeff2 )
+				denom= 0;
+			sqrtDenoms[id]= sqrt(denom);
+		}
+
+	vector<Complex> buffer( width*height ), folded( fWidth*fHeight );
+	for (int rot=0; rot<rotations; rot+=2) {
+		bool pair= rot+1 < rotations;
+	//	place the range in two rotations (real and imaginary parts) into the buffer,
+	//	reversed (modulo the dimensions) to get correlation from convolution
+		fill( buffer.begin(), buffer.end(), Complex(0) );
+		for (int x=0; x<n; ++x)
+			for (int y=0; y<n; ++y)
+				buffer[ ((width-x)&(width-1))*height + ((height-y)&(height-1)) ]= Complex
+					( rotatedPixel(*data.rangePixels,range,n,rot,x,y)
+					, pair ? rotatedPixel(*data.rangePixels,range,n,rot+1,x,y) : 0 );
+	//	only the columns [0,1) and [width-n+1,width) are nonzero
+		FFT::transformColumns( &buffer[0], log2h, false, 0, 1 );
+		FFT::transformColumns( &buffer[0], log2h, false, width-n+1, width );
+		FFT::transformRows( &buffer[0], log2w, log2h, false );
+	//	multiply by the pool's spectrum and fold the result
+		fill( folded.begin(), folded.end(), Complex(0) );
+		for (int x=0; x<width; ++x) {
+			const Complex *bufCol= &buffer[x*height], *poolCol= &poolTrans.data[x*height];
+			Complex *foldCol= &folded[ (x&(fWidth-1))*fHeight ];
+			for (int y=0; y<height; ++y)
+				foldCol[y&(fHeight-1)]+= FFT::mul( bufCol[y], poolCol[y] );
+		}
+		FFT::transform2D( &folded[0], log2w-fold, log2h-fold, true );
+	//	compute the errors of the mappings from the sums of products (like MStdEncoder)
+		for (int i=0; i<domsInRow; ++i)
+			for (int j=0; j<domsInCol; ++j) {
+				int id= i*domsInCol+j;
+				Real sqrtDenom= sqrtDenoms[id];
+				if (!sqrtDenom)
+					continue;
+				const Complex &products= folded[ i*step*fHeight + j*step ];
+				for (int r=rot; r<rot+1+pair; ++r) {
+					Real rdSum= ( r==rot ? products.real() : products.imag() ) * scale;
+					Real nRDs_RsDs= data.pixCount*rdSum - data.rSum*dSums[id];
+					if ( !data.allowInversion && nRDs_RsDs<0 )
+						continue;
+					Real error= data.quantError
+						? data.qrAvg * ( data.pixCount*data.qrAvg - ldexp(data.rSum,1) )
+							+ data.r2Sum + data.qrDev
+							* ( data.pixCount*data.qrDev - ldexp(abs(nRDs_RsDs)*sqrtDenom,1) )
+						: ldexp( data.rnDev2 - data.rnDev*abs(nRDs_RsDs)*sqrtDenom, 1 )
+							/ data.pixCount;
+					if ( !(error<maxSE) )
+						continue;
+					Candidate candidate;
+					candidate.error= error;
+					candidate.prediction= Prediction( idBegin+id, r );
+					candidates.push_back(candidate);
+				}
+			}
+	}
+}
+
+MFFTPredictor::Predictions& MFFTPredictor::OneRangePredictor
+::getChunk(float maxPredictedSE,Predictions &store) {
+	store.clear();
+	if (!useFFT) { // return all the domains in all the rotations in one chunk
+		if (computed)
+			return store;
+		computed= true;
+		int domCount= data.poolInfos->back().indexBegin
+		, rotations= data.allowRotations ? 8 : 1;
+		store.reserve(domCount*rotations);
+		for (int id=0; id<domCount; ++id)
+			for (int r=0; r<rotations; ++r)
+				store.push_back( Prediction(id,r) );
+		return store;
+	}
+	if (!computed) {
+		computeCandidates(maxPredictedSE);
+		computed= true;
+	}
+//	return the best candidates while they can improve the best error
+	while ( (int)store.size()<chunkSize && !candidates.empty()
+	&& candidates.front().error < maxPredictedSE ) {
+		store.push_back( candidates.front().prediction );
+		pop_heap( candidates.begin(), candidates.end() );
+		candidates.pop_back();
+	}
+	return store;
+}
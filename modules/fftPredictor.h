@@ -0,0 +1,117 @@
+#ifndef FFTPREDICTOR_HEADER_
+#define FFTPREDICTOR_HEADER_
+
+#include "../headers.h"
+#include "../fftUtil.h"
+
+#include <QMutex>
+
+/// \ingroup modules
+/** Predictor for MStdEncoder with the same results as the brute force.
+ *	The domains of a pool form a regular lattice, so the sums of products of a range block
+ *	with all the domains of a pool are obtained at once from the cross-correlation
+ *	of the block and the whole pool, computed by FFT for two rotations at a time.
+ *	The errors of all the mappings are computed like in the encoder (without big-scaling
+ *	penalty, so they are never higher) and the domains are returned from the best one
+ *	while their errors are below the best error found. FFT is used for regular
+ *	range blocks on the levels where it's cheaper than direct comparing, otherwise
+ *	all the domains are returned like in MNoPredictor. */
+class MFFTPredictor: public IStdEncPredictor {
+
+	DECLARE_TypeInfo( MFFTPredictor, "FFT predictor"
+	, "Predictor for standard encoder computing the errors of all domains by FFT"
+	, {
+		label:	"Prediction chunk size",
+		desc:	"The number of predicted domains in a chunk",
+		type:	settingInt(1,4,64)
+	}, {
+		label:	"Use FFT",
+		desc:	"Use FFT only on the levels where it's cheaper\n"
+				"than direct comparing, or for all regular range blocks",
+		type:	settingCombo("if cheaper\nalways",0)
+	} )
+
+protected:
+	/** Indices for settings */
+	enum Settings { ChunkSize, AlwaysFFT };
+
+public:
+	typedef ISquareEncoder::LevelPoolInfos::value_type PoolInfos;
+protected:
+	/** The Fourier transform of a pool padded by zeros to power-of-two dimensions */
+	struct PoolTransform {
+		int log2w	///  log2 of the width of the transform
+		, log2h;	///< log2 of the height of the transform
+		std::vector<FFT::Complex> data; ///< the transform (column-major)
+	};
+
+//	Module's data
+	std::vector<PoolTransform*> poolTransforms;	///< The transforms of pools (can be missing)
+	QMutex poolTransformsMutex;	///< The lock for #poolTransforms (they're made on demand)
+
+protected:
+//	Construction and destruction
+	/** Only call ::cleanUp */
+	~MFFTPredictor() { cleanUp(); }
+
+public:
+/**	\name IStdEncPredictor interface
+ *	@{ */
+	void prepare( const ISquareDomains::PoolList &, const ISquareEncoder::LevelPoolInfos &
+	, int, int, bool ) {} // the pools are transformed on demand
+	IOneRangePredictor* newPredictor(const NewPredictorData &data);
+
+	void cleanUp() {
+		clearContainer(poolTransforms);
+		poolTransforms.clear();
+	}
+///	@}
+
+protected:
+	/** Returns the transform of the pool \p poolID, makes it if needed, thread-safe */
+	const PoolTransform& getPoolTransform( const ISquareDomains::PoolList &pools, int poolID );
+	/** Returns whether FFT is expected to be cheaper than direct comparing for \p data */
+	static bool fftPaysOff(const NewPredictorData &data);
+
+protected:
+	/** Implementation of the one-range-predictor from IStdEncPredictor interface */
+	class OneRangePredictor: public IOneRangePredictor {
+		friend class MFFTPredictor;
+
+		/** A predicted mapping and its error */
+		struct Candidate {
+			float error;			///< The error of the mapping
+			Prediction prediction;	///< The domain and its rotation
+
+			/** Reverse comparison according to ::error (for heaps with the lowest on top) */
+			bool operator<(const Candidate &other) const
+				{ return error>other.error; }
+		};
+
+		MFFTPredictor &owner;		///< The module that created the predictor
+		NewPredictorData data;		///< The data of the range block
+		int chunkSize;				///< The maximal number of predictions in a chunk
+		bool useFFT					///  Whether FFT is used (otherwise all domains are returned)
+		, computed;					///< Whether #candidates have been computed
+		std::vector<Candidate> candidates; ///< The remaining candidates (a heap)
+
+		/** Only initializes the members */
+		OneRangePredictor( MFFTPredictor &owner_, const NewPredictorData &data_
+		, int chunkSize_, bool useFFT_ )
+		: owner(owner_), data(data_), chunkSize(chunkSize_), useFFT(useFFT_), computed(false) {}
+
+		/** Computes the errors of all the mappings and makes a heap of #candidates
+		 *	from the ones with the error below \p maxSE */
+		void computeCandidates(float maxSE);
+		/** Adds the candidates for the domains of the pool \p poolID into #candidates */
+		void addPoolCandidates(int poolID,float maxSE);
+	public:
+	/**	\name IOneRangePredictor interface
+	 *	@{ */
+		Predictions& getChunk(float maxPredictedSE,Predictions &store);
+	///	@}
+	}; // MFFTPredictor::OneRangePredictor class
+
+}; // MFFTPredictor class
+
+#endif // FFTPREDICTOR_HEADER_
@@ -12,6 +12,8 @@ class MNoPredictor: public IStdEncPredictor {
 public:
 /**	\name IStdEncPredictor interface
  *	@{ */
+	void prepare( const ISquareDomains::PoolList &, const ISquareEncoder::LevelPoolInfos &
+	, bool ) {} // nothing to prepare
 	IOneRangePredictor* newPredictor(const NewPredictorData &data)
 		{ return new OneRangePredictor( data.poolInfos->back().indexBegin, data.allowRotations ); }
 	void cleanUp() {} // nothing to clean up
@@ -1,5 +1,8 @@
 #include "quadTree.h"
 #include "../fileUtil.h"
+#include "../threadUtil.h"
+
+#include <new>
 
 using namespace std;
 
@@ -27,8 +30,8 @@ void MQuadTree::encode(const PlaneBlock &toEncode) {
 //	if allowed, prepare accelerators for heuristic dividing
 	if ( heuristicAllowed() )
 		toEncode.summers_makeValid();
-//	create a new root, encode it via a recursive routine
-	root= new Node( Block(0,0,toEncode.width,toEncode.height) );
+//	create a new root in place (a copy wouldn't be its own brother), encode it recursively
+	root= new( newNodes(1) ) Node( Block(0,0,toEncode.width,toEncode.height) );
 	root->encode(toEncode);
 //	generate the fringe, let the encoder process it
 	root->getHilbertList(fringe);
@@ -54,10 +57,10 @@ void MQuadTree::readData_buildRanges(istream &file,const PlaneBlock &block) {
 	NodeExtremes extremes;
 	extremes.min= get<Uchar>(file)+zoom;
 	extremes.max= get<Uchar>(file)+zoom;
-//	build the range tree
+//	build the range tree (the root is created in place, see ::encode)
 	BitReader bitReader(file);
-	root= new Node( Block(0,0,block.width,block.height) );
-	root->fromFile(bitReader,extremes);
+	root= new( newNodes(1) ) Node( Block(0,0,block.width,block.height) );
+	root->fromFile(bitReader,extremes,*this);
 //	generate the fringe of the range tree
 	root->getHilbertList(fringe);
 }
@@ -75,38 +78,34 @@ void MQuadTree::Node::disconnect() {
 	prev->brother= this->brother;
 }
 
-void MQuadTree::Node::deleteSons() {
-// 	delete all sons
-	if (!son)
-        return;
-    Node *now= son;
-    do {
-        Node *next= now->brother;
-        delete now;
-        now= next;
-    } while (now!=son);
-    son= 0;
-}
-
-void MQuadTree::Node::divide() {
+void MQuadTree::Node::divide(MQuadTree &mod) {
 //	check against dividing already divided self
 	ASSERT(!son);
 	short size= powers[level-1];
 	short xmid= min<short>( x0+size, xend );
 	short ymid= min<short>( y0+size, yend );
+	bool hasRight= xmid<xend, hasBottom= ymid<yend;
+//	allocate all the sons at once (to have them together in memory)
+	Node *next= mod.newNodes( 1 + hasRight + hasBottom + (hasRight && hasBottom) );
 //  top-left (don't know the brother yet, using 0)
-    son= new Node( Block(x0,y0,xmid,ymid), this, 0 );
+    son= next++;
+    *son= Node( Block(x0,y0,xmid,ymid), this, 0 );
     Node *last= son;
 //  top-right
-    if (xmid < xend) {
-        last= new Node( Block(xmid,y0,xend,ymid), this, last );
+    if (hasRight) {
+        *next= Node( Block(xmid,y0,xend,ymid), this, last );
+        last= next++;
 //  bottom-right
-        if (ymid < yend)
-            last= new Node( Block(xmid,ymid,xend,yend), this, last );
+        if (hasBottom) {
+            *next= Node( Block(xmid,ymid,xend,yend), this, last );
+            last= next++;
+        }
     }
 //  bottom-left
-    if (ymid < yend)
-        last= new Node( Block(x0,ymid,xmid,yend), this, last );
+    if (hasBottom) {
+        *next= Node( Block(x0,ymid,xmid,yend), this, last );
+        last= next++;
+    }
 //  son finish
 	son->brother= last;
 }
@@ -155,7 +154,7 @@ int MQuadTree::Node::getSonCount() const {
 	return count;
 }
 
-bool MQuadTree::Node::encode(const PlaneBlock &toEncode) {
+bool MQuadTree::Node::encode(const PlaneBlock &toEncode,const RangeList *seedRanges) {
 	if (*toEncode.settings->updateInfo.terminate)
 		throw exception();
 		
@@ -166,7 +165,7 @@ bool MQuadTree::Node::encode(const PlaneBlock &toEncode) {
 //	check for minimal level -> cannot be divided, find the best domain
 	if ( level == mod->minLevel() ) {
 	//	try to find the best mapping, not restricting the max.\ SE and exit
-		toEncode.encoder->findBestSE(*this,true);
+		toEncode.encoder->findBestSE(*this,true,seedRanges);
 		plSet.updateInfo.incProgress(pixCount);
 		return false;
 	}
@@ -186,7 +185,7 @@ bool MQuadTree::Node::encode(const PlaneBlock &toEncode) {
 				tryEncode= false;
 		}
 	//	if we decided to try to encode, do it and return if the quality is sufficient
-		if ( tryEncode && toEncode.encoder->findBestSE(*this) <= maxSE ) {
+		if ( tryEncode && toEncode.encoder->findBestSE(*this,false,seedRanges) <= maxSE ) {
 			plSet.updateInfo.incProgress(pixCount);
 			return false;
 		}
@@ -196,18 +195,20 @@ bool MQuadTree::Node::encode(const PlaneBlock &toEncode) {
 		#endif
 	}
 //	the range needs to be divided, try to encode the sons
-	divide();
-	bool aSonDivided= false;
-	Node *now= son;
-	do {// if any of the sons is divided, set tryEncode to true
-		bool divided= now->encode(toEncode);
-		aSonDivided= aSonDivided || divided;
-	} while ( (now=now->brother) != son );
+	divide(*mod);
+	bool aSonDivided= encodeSons(toEncode);
 //	if (I unsuccessfully tried to encode or a son was divided) or (I have too big level), return
 	if ( aSonDivided || tryEncode || level > mod->maxLevel() )
 		return true;
-//	this range still has a chance, try to encode it
-	if ( toEncode.encoder->findBestSE(*this) <= maxSE ) {
+//	this range still has a chance, try to encode it (seeded by the sons);
+//	it's the first search for this range (a failed one returns above), nothing to reuse
+	ASSERT(!encoderData);
+	RangeList sons;
+	Node *now= son;
+	do
+		sons.push_back(now);
+	while ( (now=now->brother) != son );
+	if ( toEncode.encoder->findBestSE(*this,false,&sons) <= maxSE ) {
 		#ifndef NDEBUG
 			++debugCast<MQuadTree*>(toEncode.ranges)->badDivides;
 		#endif
@@ -221,6 +222,64 @@ bool MQuadTree::Node::encode(const PlaneBlock &toEncode) {
 	}
 }
 
+/** Encodes one son of a node as a task in TaskPool */
+class MQuadTree::SonTask: public QRunnable {
+	Node *node;					///< the node to encode
+	const PlaneBlock &toEncode;	///< the block the node belongs to
+	const RangeList *seeds;		///< the ranges to seed the node's search from
+	bool &divided;				///< where to store the result of Node::encode
+public:
+	/** Only initializes the members */
+	SonTask( Node *node_, const PlaneBlock &toEncode_, const RangeList *seeds_, bool &divided_ )
+	: node(node_), toEncode(toEncode_), seeds(seeds_), divided(divided_) {}
+	/** Encodes the node (virtual method) */
+	void run()
+		{ divided= node->encode(toEncode,seeds); }
+}; // MQuadTree::SonTask class
+
+bool MQuadTree::Node::encodeSons(const PlaneBlock &toEncode) {
+	ASSERT(son);
+	MQuadTree *mod= debugCast<MQuadTree*>(toEncode.ranges);
+//	the sons on the minimal level are too small to be worth a task
+	TaskPool *pool= mod->parallelSubtrees() && level-1 > mod->minLevel()
+		? TaskPool::current() : 0;
+	bool aSonDivided= false;
+//	all the sons are seeded by my mapping (if I tried to encode myself, it's already known)
+	RangeList seeds(1,this);
+	if (!pool) {
+	//	the sons on the minimal level are also seeded by their already encoded brothers
+	//	(not the bigger ones - the result mustn't depend on parallel encoding)
+		bool seeding= ( level-1 == mod->minLevel() );
+		Node *now= son;
+		do {// if any of the sons is divided, set aSonDivided to true
+			bool divided= now->encode(toEncode,&seeds);
+			aSonDivided= aSonDivided || divided;
+			if (seeding)
+				seeds.push_back(now);
+		} while ( (now=now->brother) != son );
+		return aSonDivided;
+	}
+//	start all the sons but the first one as tasks, encode the first one myself
+	bool divided[4]= {false,false,false,false};
+	TaskGroup group;
+	int i= 1;
+	for (Node *now=son->brother; now!=son; now=now->brother, ++i)
+		pool->start( new SonTask(now,toEncode,&seeds,divided[i]), group );
+	bool failed= false;
+	try {
+		divided[0]= son->encode(toEncode,&seeds);
+	} catch (exception &e) {
+		failed= true;
+	}
+//	the tasks refer to local variables -> wait for them even in case of failure
+	pool->wait(group);
+	checkThrow( !failed && !group.hasFailed() );
+
+	for (i=0; i<4; ++i)
+		aSonDivided= aSonDivided || divided[i];
+	return aSonDivided;
+}
+
 void MQuadTree::Node::toFile(BitWriter &file,NodeExtremes extremes) {
 	if (son) {
 	//  Node is divided
@@ -237,14 +296,14 @@ void MQuadTree::Node::toFile(BitWriter &file,NodeExtremes extremes) {
 			file.putBits(0,1);
 }
 
-void MQuadTree::Node::fromFile(BitReader &file,NodeExtremes extremes) {
+void MQuadTree::Node::fromFile(BitReader &file,NodeExtremes extremes,MQuadTree &mod) {
 //	should I be divided ?
 	bool div= level>extremes.max || ( level>extremes.min && file.getBits(1) ) ;
 	if (div) {
-		divide();
+		divide(mod);
 		Node *now= son;
 		do
-			now->fromFile(file,extremes);
+			now->fromFile(file,extremes,mod);
 		while ( (now=now->brother) != son );
 	}
 }
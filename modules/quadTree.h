@@ -3,6 +3,8 @@
 
 #include "../headers.h"
 
+#include <QMutex>
+
 //	forwards from "fileUtils.h"
 class BitWriter;
 class BitReader;
@@ -28,20 +30,27 @@ class MQuadTree: public ISquareRanges {
 		desc:	"Pre-divide the ranges heuristically and later divide ranges\n"
 				"with bad quality and try to merge ranges with good quality",
 		type:	settingCombo("no\nyes",1)
+	}, {
+		label:	"Parallel encoding of subtrees",
+		desc:	"Encode the sons of divided ranges as separate tasks\n"
+				"that can be processed by idle threads",
+		type:	settingCombo("no\nyes",1)
 	} )
 	// \todo better heuristics via changes in ISquareEncoder interface
 	
 protected:
 	class Node;	// forward declaration, derived from RangeNode
 	friend class Node;
+	class SonTask;	// forward declaration, defined in quadTree.cpp
 
 protected:
 	/** Indices for settings */
-	enum Settings { MinLevel, MaxLevel, HeuristicAllowed };
+	enum Settings { MinLevel, MaxLevel, HeuristicAllowed, ParallelSubtrees };
 //	Settings-retrieval methods
 	int minLevel()			{ return settingsInt(MinLevel); }
 	int maxLevel()			{ return settingsInt(MaxLevel); }
 	bool heuristicAllowed()	{ return settingsInt(HeuristicAllowed); }
+	bool parallelSubtrees()	{ return settingsInt(ParallelSubtrees); }
 
 protected:
 //	Module's data
@@ -62,14 +71,16 @@ protected:
 	, badDivides(0), triedMerges(0), badTries(0), planeBlock(0)
 	#endif
 		{}
-	/** Only deletes #root */
-	~MQuadTree() { delete root; }
 public:
 /** \name ISquareRanges interface
  *	@{ */
 	void encode(const PlaneBlock &toEncode);
 	const RangeList& getRangeList() const
 		{ return fringe; }
+	void getLevelSpan(int &minLevel_,int &maxLevel_) const {
+		minLevel_= settingsInt(MinLevel);
+		maxLevel_= settingsInt(MaxLevel);
+	}
 
 	/* The module doesn't need to preserve any settings */
 	void writeSettings(std::ostream&) {}
@@ -96,31 +107,50 @@ protected:
 		/** Disconnects itself from father and brothers */
 		void disconnect();
 	public:
+		/** Creates an unused node (only to be allocated by #nodeAllocator) */
+		Node()
+		: RangeNode( Block(), 0 ), father(0), brother(0), son(0) {}
 		/** Constuctor for initializing a new root */
 		Node(const Block &block)
 		: RangeNode( block, log2ceil(std::max(block.width(),block.height())) )
 		, father(0), brother(this), son(0) {}
-		/** Only calls #deleteSons */
-		~Node() { deleteSons(); }
-		/** Only deletes the sons - they do the same recursively */
-		void deleteSons();
+		/** Only disconnects the sons (the memory is freed with #nodeAllocator) */
+		void deleteSons()
+			{ son= 0; }
 
-		/** Divides the Range in four */
-		void divide();
+		/** Divides the Range in four (the sons are allocated in \p mod) */
+		void divide(MQuadTree &mod);
 		/** Recursively walks the Ranges in the QuadTree according to a Hilbert curve
 		 *	and fills the vector with pointers to leaves in this order */
 		void getHilbertList(RangeList &list,char start=0,char clockwise=1);
 		/** Counts the sons of this node and returns their number */
 		int getSonCount() const;
 
-		/** Encodes a range block (recursively), returns whether it was divided */
-		bool encode(const PlaneBlock &toEncode);
+		/** Encodes a range block (recursively), returns whether it was divided,
+		 *	the already encoded \p seedRanges can be used to seed the search */
+		bool encode(const PlaneBlock &toEncode,const RangeList *seedRanges=0);
+		/** Encodes all the sons (possibly in parallel, seeded by this node's insufficient
+		 *	mapping, if it was tried), returns whether any was divided */
+		bool encodeSons(const PlaneBlock &toEncode);
 
 		/** Saves sons into a stream (extremes contain the min.\ and max.\ block level) */
 		void toFile(BitWriter &file,NodeExtremes extremes);
-		/** Loads sons from a stream (extremes contain the min.\ and max.\ block level) */
-		void fromFile(BitReader &file,NodeExtremes extremes);
+		/** Loads sons from a stream (extremes contain the min.\ and max.\ block level),
+		 *	the sons are allocated in \p mod */
+		void fromFile(BitReader &file,NodeExtremes extremes,MQuadTree &mod);
 	}; // MQuadTree::Node class
+
+protected:
+	/** The allocator of all the nodes, they are freed at once with the module
+	 *	(the merged nodes are only disconnected) */
+	BulkAllocator<Node> nodeAllocator;
+	QMutex nodeMutex;	///< The lock for #nodeAllocator (the sons are encoded in parallel)
+
+	/** Allocates \p count consecutive nodes (thread-safe) */
+	Node* newNodes(int count) {
+		QMutexLocker locker(&nodeMutex);
+		return nodeAllocator.makeField(count);
+	}
 };
 
 #endif // QUADTREE_HEADER_
@@ -1,9 +1,9 @@
 #include "root.h"
 #include "../util.h"
 #include "../fileUtil.h"
+#include "../threadUtil.h"
 
 #include <QImage>
-#include <QThreadPool>
 
 using namespace std;
 
@@ -14,25 +14,37 @@ QImage MRoot::toImage() {
 }
 
 namespace NOSPACE {
-	/** Represents a scheduled encoding job for use in QThreadPool */
+	/** Represents a scheduled encoding job for use in TaskPool */
 	class ScheduledJob: public QRunnable {
 		IShapeTransformer *worker;	///< the worker to perform the job
 		int job;					///< the job's identifier
-		volatile bool &errorFlag;	///< the flag to set in case of failure
 	public:
-		/** Creates a new scheduled job, failure reported in \p errorFlag_ */
-		ScheduledJob( IShapeTransformer *worker_, int job_, volatile bool &errorFlag_ )
-		: worker(worker_), job(job_), errorFlag(errorFlag_) {}
+		/** Creates a new scheduled job, failure is reported by the exception */
+		ScheduledJob( IShapeTransformer *worker_, int job_ )
+		: worker(worker_), job(job_) {}
 		
-		/** Just makes #worker do the #job and sets #errorFlag in case of error (virtual method) */
-		void run() {
-			try {
-				worker->jobEncode(job);
-			} catch (exception &e) {
-				errorFlag= true;
-			}
-		}
+		/** Just makes #worker do the #job (virtual method) */
+		void run()
+			{ worker->jobEncode(job); }
 	}; // ScheduledJob class
+
+	/** Represents a scheduled decoding action of a job for use in TaskPool */
+	class ScheduledDecodeJob: public QRunnable {
+		IShapeTransformer *worker;	///< the worker to perform the job
+		int job						///  the job's identifier
+		, count;					///< the parameter for IShapeTransformer::jobDecodeAct
+		DecodeAct action;			///< the action to perform
+		int &iterations;			///< where to store the number of performed iterations
+	public:
+		/** Creates a new scheduled decoding action for a job */
+		ScheduledDecodeJob( IShapeTransformer *worker_, int job_, DecodeAct action_, int count_
+		, int &iterations_ )
+		: worker(worker_), job(job_), count(count_), action(action_), iterations(iterations_) {}
+		
+		/** Just makes #worker do the #action on the #job (virtual method) */
+		void run()
+			{ iterations= worker->jobDecodeAct(job,action,count); }
+	}; // ScheduledDecodeJob class
 }
 bool MRoot::encode(const QImage &toEncode,const UpdateInfo &updateInfo) {
 	ASSERT( getMode()==Clear && settings && moduleColor() && moduleShape() 
@@ -56,14 +68,20 @@ bool MRoot::encode(const QImage &toEncode,const UpdateInfo &updateInfo) {
 			return false;
 		}
 	else {
-	//	multi-threaded mode: create ScheduleJob instances and push them into a QThreadPool
-		volatile bool errorFlag= false;
-		QThreadPool jobPool;
-		jobPool.setMaxThreadCount( maxThreads() );
+	//	multi-threaded mode: create ScheduleJob instances and push them into the shared
+	//	TaskPool, the jobs can split themselves further (idle threads steal their parts);
+	//	the most expensive jobs are started first, so no thread finishes much later
+		vector< pair<float,int> > costs(jobCount);
 		for (int job=0; job<jobCount; ++job)
-			jobPool.start( new ScheduledJob(moduleShape(),job,errorFlag) );
-		jobPool.waitForDone();
-		if (errorFlag)
+			costs[job]= make_pair( -moduleShape()->jobCost(job), job );
+		sort( costs.begin(), costs.end() );
+
+		TaskPool &jobPool= TaskPool::shared( maxThreads() );
+		TaskGroup jobGroup( maxThreads() );
+		for (int i=0; i<jobCount; ++i)
+			jobPool.start( new ScheduledJob(moduleShape(),costs[i].second), jobGroup );
+		jobPool.wait(jobGroup);
+		if ( jobGroup.hasFailed() )
 			return false;
 	}
 //	encoding successful - change the mode and return true
@@ -71,13 +89,27 @@ bool MRoot::encode(const QImage &toEncode,const UpdateInfo &updateInfo) {
 	return true;
 }
 
-void MRoot::decodeAct(DecodeAct action,int count) {
+int MRoot::decodeAct(DecodeAct action,int count) {
 	ASSERT( getMode()!=Clear && settings && moduleColor() && moduleShape() );
 	int jobCount= moduleShape()->jobCount();
-	ASSERT(jobCount>0);
-//	there will be probably no need to parallelize decoding
-	for (int i=0; i<jobCount; ++i)
-		moduleShape()->jobDecodeAct(i,action,count);
+	ASSERT( jobCount>0 && maxThreads()>=1 );
+//	process the jobs
+	vector<int> iterations(jobCount,0);
+	if ( maxThreads()==1 || jobCount==1 )
+	//	simple one-thread mode: processes jobs sequentially
+		for (int i=0; i<jobCount; ++i)
+			iterations[i]= moduleShape()->jobDecodeAct(i,action,count);
+	else {
+	//	multi-threaded mode: the same as for encoding, the jobs are independent
+		TaskPool &jobPool= TaskPool::shared( maxThreads() );
+		TaskGroup jobGroup( maxThreads() );
+		for (int job=0; job<jobCount; ++job)
+			jobPool.start( new ScheduledDecodeJob
+				( moduleShape(), job, action, count, iterations[job] ), jobGroup );
+		jobPool.wait(jobGroup);
+	}
+//	the jobs converge independently, return the count of the slowest one
+	return *max_element( iterations.begin(), iterations.end() );
 }
 
 bool MRoot::toStream(std::ostream &file) {
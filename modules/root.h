@@ -6,7 +6,7 @@
 #include <QThread> // ::idealThreadCount
 
 /// \ingroup modules
-/** The root module implementation. Controls the number of encoding threads,
+/** The root module implementation. Controls the number of encoding and decoding threads,
  *	the color-transforming module (IColorTransformer)
  *	the pixel-shape-transforming module (IShapeTransformer), quality 0-100%,
  *	the module for quality conversion (IQuality2SE) and the maximum domain count. */
@@ -17,7 +17,8 @@ class MRoot: public IRoot {
  	, "Standard root module"
 	, {
 		label:	"Maximal number of threads",
-		desc:	"Note: the actual number of threads is bound by\n"
+		desc:	"Note: unless the parts can be encoded in parallel,\n"
+				"the actual number of threads is bound by\n"
 				"(the number of parts)*(the number of color planes)",
 		type:	settingInt(1,QThread::idealThreadCount(),16)
 	}, {
@@ -82,7 +83,7 @@ public:
 	QImage toImage();
 
 	bool encode(const QImage &toEncode,const UpdateInfo &updateInfo);
-	void decodeAct(DecodeAct action,int count=1);
+	int decodeAct(DecodeAct action,int count=1);
 
 	bool toStream(std::ostream &file);
 	bool fromStream(std::istream &file,int zoom);
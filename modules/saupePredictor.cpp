@@ -2,28 +2,86 @@
 #include "stdDomains.h" // because of HalfShrinker
 using namespace std;
 
+/** Builds the tree for one level as a task in TaskPool */
+class MSaupePredictor::LevelTask: public QRunnable {
+	MSaupePredictor *predictor;					///< the predictor to build the tree for
+	const ISquareDomains::PoolList &pools;		///< the domain pools
+	const PoolInfos &poolInfos;					///< the pool infos for the level
+	int level;									///< the level of the tree
+	bool allowInversion;						///< whether inversion is allowed
+public:
+	/** Only initializes the members */
+	LevelTask( MSaupePredictor *predictor_, const ISquareDomains::PoolList &pools_
+	, const PoolInfos &poolInfos_, int level_, bool allowInversion_ )
+	: predictor(predictor_), pools(pools_), poolInfos(poolInfos_), level(level_)
+	, allowInversion(allowInversion_) {}
+	/** Builds the tree and stores it in MSaupePredictor::levelTrees (virtual method) */
+	void run() {
+		predictor->levelTrees[level]= predictor->createTree
+			( pools, poolInfos, level, allowInversion, TaskPool::current() );
+	}
+}; // MSaupePredictor::LevelTask class
+
+void MSaupePredictor::prepare( const ISquareDomains::PoolList &pools
+, const ISquareEncoder::LevelPoolInfos &levelPoolInfos, int minLevel, int maxLevel
+, bool allowInversion ) {
+	if ( !settingsInt(PrebuildTrees) )
+		return; // the trees will be built on demand
+	ASSERT( levelTrees.empty() && minLevel>=0 );
+	int levelCount= levelPoolInfos.size();
+	levelTrees.resize( levelCount, (Tree*)0 );
+//	build the trees for the used levels with some domains, in parallel if possible
+	TaskPool *taskPool= TaskPool::current();
+	TaskGroup group;
+	bool failed= false;
+	try {
+		for (int level=minLevel; level<=maxLevel && level<levelCount; ++level) {
+			const PoolInfos &poolInfos= levelPoolInfos[level];
+			if ( poolInfos.empty() || poolInfos.back().indexBegin<=0 )
+				continue; // no domains on the level
+			if (taskPool)
+				taskPool->start
+					( new LevelTask(this,pools,poolInfos,level,allowInversion), group );
+			else
+				levelTrees[level]= createTree( pools, poolInfos, level, allowInversion, 0 );
+		}
+	} catch (exception &e) {
+		failed= true;
+	}
+//	the tasks refer to our data -> wait for them even in case of failure
+	if (taskPool)
+		taskPool->wait(group);
+	checkThrow( !failed && !group.hasFailed() );
+}
+
 IStdEncPredictor::IOneRangePredictor* MSaupePredictor
 ::newPredictor(const NewPredictorData &data) {
-//	ensure the levelTrees vector is long enough
 	int level= data.rangeBlock->level;
-	if ( level >= (int)levelTrees.size() )
-		levelTrees.resize( level+1, (Tree*)0 );
-//	ensure the tree is built for the level
-	Tree *tree= levelTrees[level];
-	if (!tree)
-		tree= levelTrees[level]= createTree(data);
+	Tree *tree;
+	{//	the trees can be requested concurrently -> lock them
+		QMutexLocker locker(&levelTreesMutex);
+	//	ensure the levelTrees vector is long enough
+		if ( level >= (int)levelTrees.size() )
+			levelTrees.resize( level+1, (Tree*)0 );
+	//	ensure the tree is built for the level (without tasks - waiting for them
+	//	could run another encoding task that would try to lock the mutex again)
+		tree= levelTrees[level];
+		if (!tree)
+			tree= levelTrees[level]= createTree
+				( *data.pools, *data.poolInfos, level, data.allowInversion, 0 );
+	//	the debugging stats are also shared by concurrent predictors
+		DEBUG_ONLY( maxpred+= tree->count*(data.allowRotations?8:1)*(data.allowInversion?2:1); )
+	}
 	ASSERT(tree);
 //	get the max. number of domains to predict and create the predictor
 	int maxPredicts= (int)ceil(maxPredCoeff()*tree->count);
 	if (maxPredicts<=0)
 		maxPredicts= 1;
 	OneRangePredictor *result= 
-		new OneRangePredictor( data, settingsInt(ChunkSize), *tree, maxPredicts );
+		new OneRangePredictor( *this, data, settingsInt(ChunkSize), *tree, maxPredicts
+		, approximation() );
 		
-	#ifndef NDEBUG // collecting debugging stats
-		maxpred+= tree->count*(data.allowRotations?8:1)*(data.allowInversion?2:1);
-		result->predicted= &predicted;
-	#endif
+	DEBUG_ONLY( result->predicted= 0; )
 
 	return result;
 }
@@ -164,40 +222,90 @@ bool MSaupePredictor::refineRange
 	return true;
 }
 
-MSaupePredictor::Tree* MSaupePredictor::createTree(const NewPredictorData &data) {
+/** Refines a part of domain blocks of a pool (a range of columns) as a task in TaskPool */
+class MSaupePredictor::RefineTask: public QRunnable {
+	const ISquareDomains::Pool &pool;	///< the pool of the domains
+	int density		///  the density of the domains in the pool
+	, x0Begin		///  the x-coordinate of the first column of domains
+	, x0End			///  the x-coordinate past the last column of domains
+	, yEnd			///  the y-coordinate past the domains in a column
+	, realLevel		///  the level of the domains
+	, predLevel;	///< the level of the refined blocks
+	bool allowInversion;	///< whether inversion is allowed
+	KDReal *result;	///< where to store the refined blocks
+public:
+	/** Only initializes the members */
+	RefineTask( const ISquareDomains::Pool &pool_, int density_, int x0Begin_, int x0End_
+	, int yEnd_, int realLevel_, int predLevel_, bool allowInversion_, KDReal *result_ )
+	: pool(pool_), density(density_), x0Begin(x0Begin_), x0End(x0End_), yEnd(yEnd_)
+	, realLevel(realLevel_), predLevel(predLevel_), allowInversion(allowInversion_)
+	, result(result_) {}
+	/** Refines the domain blocks on [x0,y0] for all the columns (virtual method) */
+	void run() {
+		int predPixCount= powers[2*predLevel];
+		for (int x0=x0Begin; x0<x0End; x0+=density)
+			for (int y0=0; y0<yEnd; y0+=density) {
+				refineDomain( pool, x0, y0, allowInversion, realLevel, predLevel, result );
+				result+= predPixCount;
+			}
+	}
+}; // MSaupePredictor::RefineTask class
+
+MSaupePredictor::Tree* MSaupePredictor::createTree
+( const ISquareDomains::PoolList &pools, const PoolInfos &poolInfos
+, int level, bool allowInversion, TaskPool *taskPool ) {
 //	compute some accelerators
-	const ISquareEncoder::LevelPoolInfos::value_type &poolInfos= *data.poolInfos;
 	const int domainCount= poolInfos.back().indexBegin
-	, realLevel= data.rangeBlock->level
+	, realLevel= level
 	, predLevel= getPredLevel(realLevel)
 	, realSide= powers[realLevel]
 	, predPixCount= powers[2*predLevel];
 	ASSERT(realLevel>=predLevel);
 //	create space for temporary domain pixels, can be too big to be on the stack
 	KDReal *domPix= new KDReal[ domainCount * predPixCount ];
-//	init domain-blocks from every pool
-	KDReal *domPixNow= domPix;
-	int poolCount= data.pools->size();
-	for (int poolID=0; poolID<poolCount; ++poolID) {
-	//	check we are on the place we want to be; get the current pool, density, etc.
-		ASSERT( domPixNow-domPix == poolInfos[poolID].indexBegin*predPixCount );
-		const ISquareDomains::Pool &pool= (*data.pools)[poolID];
-		int density= poolInfos[poolID].density;
-		if (!density) // no domains in this pool for this level
-			continue;
-		int poolXend= density*getCountForDensity( pool.width, density, realSide );
-		int poolYend= density*getCountForDensity( pool.height, density, realSide );
-	//	handle the domain block on [x0,y0] (for each in the pool)
-		for (int x0=0; x0<poolXend; x0+=density)
-			for (int y0=0; y0<poolYend; y0+=density) {
-				refineDomain( pool, x0, y0, data.allowInversion, realLevel, predLevel, domPixNow );
-				domPixNow+= predPixCount;
+//	init domain-blocks from every pool, in parallel by groups of columns if possible
+	enum { MinTaskDomains=1024 }; // the minimal number of domains refined in a task
+	TaskGroup group;
+	bool failed= false;
+	try {
+		int poolCount= pools.size();
+		for (int poolID=0; poolID<poolCount; ++poolID) {
+		//	get the current pool, density, etc.
+			const ISquareDomains::Pool &pool= pools[poolID];
+			int density= poolInfos[poolID].density;
+			if (!density) // no domains in this pool for this level
+				continue;
+			int domsInCol= getCountForDensity( pool.height, density, realSide );
+			int poolXend= density*getCountForDensity( pool.width, density, realSide );
+			int poolYend= density*domsInCol;
+			ASSERT( poolInfos[poolID+1].indexBegin-poolInfos[poolID].indexBegin
+				== poolXend/density*domsInCol );
+			KDReal *domPixNow= domPix + poolInfos[poolID].indexBegin*predPixCount;
+		//	handle the domain blocks on [x0,y0] (for each in the pool)
+			if (!taskPool) {
+				RefineTask( pool, density, 0, poolXend, poolYend, realLevel, predLevel
+					, allowInversion, domPixNow ).run();
+				continue;
 			}
+			int step= density * max( 1, MinTaskDomains/domsInCol );
+			for (int x0=0; x0<poolXend; x0+=step)
+				taskPool->start( new RefineTask( pool, density, x0, min(x0+step,poolXend)
+					, poolYend, realLevel, predLevel, allowInversion
+					, domPixNow + (x0/density)*domsInCol*predPixCount ), group );
+		}
+	} catch (exception &e) {
+		failed= true;
+	}
+//	the tasks refer to our data -> wait for them even in case of failure
+	if (taskPool)
+		taskPool->wait(group);
+	if ( failed || group.hasFailed() ) {
+		delete[] domPix;
+		throw exception();
 	}
-	ASSERT( domPixNow-domPix == domainCount*predPixCount ); // check we are just at the end
 //	create the tree from obtained data
-	Tree *result= Tree::Builder
-		::makeTree( domPix, predPixCount, domainCount, &Tree::Builder::chooseApprox );
+	Tree *result= Tree::Builder::makeTree( domPix, predPixCount, domainCount
+		, &Tree::Builder::chooseApprox, powers[settingsInt(BucketSizeLog2)], taskPool );
 //	clean up temporaries, return the tree
 	delete[] domPix;
 	return result;
@@ -226,15 +334,33 @@ namespace MatrixWalkers {
 			{ dest= -src; }
 	};
 }
+MSaupePredictor::SearchArena* MSaupePredictor::takeArena() {
+	QMutexLocker locker(&freeArenasMutex);
+	if ( freeArenas.empty() )
+		return new SearchArena;
+	SearchArena *result= freeArenas.back();
+	freeArenas.pop_back();
+	return result;
+}
+
+void MSaupePredictor::releaseArena(SearchArena *arena) {
+	ASSERT(arena);
+	QMutexLocker locker(&freeArenasMutex);
+	freeArenas.push_back(arena);
+}
+
 MSaupePredictor::OneRangePredictor::OneRangePredictor
-( const NewPredictorData &data, int chunkSize_, const Tree &tree, int maxPredicts )
-	: chunkSize(chunkSize_), predsRemain(maxPredicts)
+( MSaupePredictor &owner_, const NewPredictorData &data, int chunkSize_
+, const Tree &tree, int maxPredicts, float epsilon )
+	: approxCoeff( 1/sqr(1+epsilon) ), owner(owner_), arena( owner_.takeArena() )
+	, chunkSize(chunkSize_), predsRemain(maxPredicts)
 	, firstChunk(true), allowRotations(data.allowRotations), isRegular(data.isRegular) 
 {
 //	compute some accelerators, allocate space for normalized range (+rotations,inversion)
 	int rotationCount= allowRotations ? 8 : 1;
 	heapCount= rotationCount * (data.allowInversion ? 2 : 1);
-	points= new KDReal[tree.length*heapCount];	
+	arena->points.resize(tree.length*heapCount);
+	points= &arena->points[0];
 	
 //	if the block isn't regular, fill the space with NaNs (to be left on unused places)
 	if (!isRegular)
@@ -275,12 +401,15 @@ MSaupePredictor::OneRangePredictor::OneRangePredictor
 			( points, pointsMiddle, pointsMiddle, MatrixWalkers::SignChanger() );
 	}
 	
-//	create all the heaps and initialize their infos (and make a heap of the infos)
-	heaps.reserve(heapCount);
+//	reset all the heaps (creating the missing ones) and initialize their infos
+//	(and make a heap of the infos)
+	vector<PointHeap*> &heaps= arena->heaps;
+	while ( PtrInt(heaps.size()) < heapCount )
+		heaps.push_back(new PointHeap);
 	infoHeap.reserve(heapCount);
 	for (int i=0; i<heapCount; ++i) {
-		PointHeap *heap= new PointHeap( tree, points+i*tree.length, !data.isRegular );
-		heaps.push_back(heap);
+		PointHeap *heap= heaps[i];
+		heap->reset( tree, points+i*tree.length, !data.isRegular );
 		infoHeap.push_back(HeapInfo( i, heap->getTopSE() ));
 	}
 //	build the heap from heap-informations
@@ -293,7 +422,7 @@ MSaupePredictor::Predictions& MSaupePredictor::OneRangePredictor
 		store.clear();
 		return store;
 	}
-	ASSERT( PtrInt(heaps.size())==heapCount && PtrInt(infoHeap.size())<=heapCount );
+	ASSERT( PtrInt(arena->heaps.size())>=heapCount && PtrInt(infoHeap.size())<=heapCount );
 //	get the number of predictions to make (may be larger for the first chunk)
 	int predCount= chunkSize;
 	if (firstChunk) {
@@ -305,14 +434,14 @@ MSaupePredictor::Predictions& MSaupePredictor::OneRangePredictor
 	if (predCount>predsRemain)
 		predCount= predsRemain;
 	predsRemain-= predCount;
-//	compute the max. normalized SE to predict
-	float maxNormalizedSE= errorNorm.normSE(maxPredictedSE);
+//	compute the max. normalized SE to predict (decreased for approximate search)
+	float maxNormalizedSE= errorNorm.normSE(maxPredictedSE) * approxCoeff;
 //	make a local working copy for the result (the prediction), adjust its size
 	Predictions result;
 	swap(result,store); // swapping is the quickest way
 	result.resize(predCount);
 //	generate the predictions
-	for (Predictions::iterator it=result.begin(); it!=result.end(); ++it) {
+	for (Predictions::iterator it=result.begin(); it!=result.end(); ) {
 		pop_heap( infoHeap.begin(), infoHeap.end() );
 		HeapInfo &bestInfo= infoHeap.back();
 	//	if the error is too high, cut the vector and exit the cycle
@@ -321,13 +450,18 @@ MSaupePredictor::Predictions& MSaupePredictor::OneRangePredictor
 			infoHeap.clear(); // to be able to exit more quickly in the next call
 			break;
 		}
-	//	fill the prediction and pop the heap
+	//	fill the prediction and pop the heap (a discarded bucket still uses up a prediction)
 		ASSERT( 0<=bestInfo.index && bestInfo.index<heapCount );
-		PointHeap &bestHeap= *heaps[bestInfo.index];
-		it->domainID= isRegular
+		PointHeap &bestHeap= *arena->heaps[bestInfo.index];
+		int domainID= isRegular
 			? bestHeap.popLeaf<false>(maxNormalizedSE)
 			: bestHeap.popLeaf<true>(maxNormalizedSE);
-		it->rotation= allowRotations ? bestInfo.index%8 : 0; // modulo - for the case of inversion
+		if (domainID>=0) {
+			it->domainID= domainID;
+			it->rotation= allowRotations ? bestInfo.index%8 : 0; // modulo - for the case of inversion
+			++it;
+		} else
+			result.pop_back();
 	//	check for emptying the heap
 		if ( !bestHeap.isEmpty() ) {
 		//	rebuild the infoHeap heap
@@ -336,15 +470,17 @@ MSaupePredictor::Predictions& MSaupePredictor::OneRangePredictor
 		} else { // just emptied a heap
 			infoHeap.pop_back();
 		//	check for emptying the last heap
-			if ( infoHeap.empty() )
+			if ( infoHeap.empty() ) {
+				result.erase( it, result.end() );
 				break;
+			}
 		}
 	}
 //	return the result
 	swap(result,store);
 
 	#ifndef NDEBUG
-	*predicted+= store.size();
+	predicted+= store.size();
 	#endif
 
 	return store;
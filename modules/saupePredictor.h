@@ -4,12 +4,15 @@
 #include "../headers.h"
 #include "../kdTree.h"
 
+#include <QMutex>
+
 /// \ingroup modules
 /** Predictor for MStdEncoder based on a theorem proven in Saupe's work.
  *	It resizes the blocks to 4x4 and normalizes them.
  *	Domains for every level are stored in a KDTree instance and searched. 
- *	The user can set the size of returned chunks of the blocks
- *	and the maximal part of domains returned. */
+ *	The user can set the size of returned chunks of the blocks,
+ *	the maximal part of domains returned, whether to build all the trees in advance,
+ *	the number of domains in the leaves of the trees and the search approximation. */
 class MSaupePredictor: public IStdEncPredictor {
 	DECLARE_debugModule;
 
@@ -23,21 +26,54 @@ class MSaupePredictor: public IStdEncPredictor {
 		label:	"Max. predicted part",
 		desc:	"The maximal part of domains predicted for a range block",
 		type:	settingInt(-20,-8,0,IntLog2)
+	}, {
+		label:	"Prebuild trees",
+		desc:	"Build the trees for all levels before encoding\n"
+				"the range blocks (in parallel, if possible)",
+		type:	settingCombo("no\nyes",1)
+	}, {
+		label:	"Domains per tree leaf",
+		desc:	"The maximal number of domains in a leaf of a tree\n"
+				"(the domains of bigger leaves are compared at once)",
+		type:	settingInt(0,3,5,IntLog2)
+	}, {
+		label:	"Search approximation",
+		desc:	"The epsilon of approximate nearest neighbour search:\n"
+				"only domains that can be (1+epsilon)-times nearer\n"
+				"than the best one found are searched (0 = exact)",
+		type:	settingFloat(0,0,2)
 	} )
 
 protected:
 	/** Indices for settings */
-	enum Settings { ChunkSize, MaxPredPart };
+	enum Settings { ChunkSize, MaxPredPart, PrebuildTrees, BucketSizeLog2, Approximation };
 
 	/**  maxPredCoeff() * "the number of domains" == "max. number of predictions" */
 	Real maxPredCoeff()	{ return ldexp( Real(1), settingsInt(MaxPredPart) ); }
+	/** The epsilon of the approximate search */
+	float approximation()	{ return settings[Approximation].val.f; }
 
 public:
 	typedef float KDReal;		///< The floating point type used in the KD-tree
 	typedef KDTree<KDReal> Tree;///< The version of KDTree in use
+	typedef ISquareEncoder::LevelPoolInfos::value_type PoolInfos;
 protected:
+	class LevelTask;	// forward declaration, defined in saupePredictor.cpp
+	class RefineTask;	// forward declaration, defined in saupePredictor.cpp
+
+	/** Reusable storage of a OneRangePredictor (not to reallocate it for every range block) */
+	struct SearchArena {
+		std::vector<Tree::PointHeap*> heaps;///< The heaps (reset for every range block)
+		std::vector<KDReal> points;			///< Space for the normalized range rotations
+		/** Only deletes the heaps */
+		~SearchArena() { clearContainer(heaps); }
+	};
+
 //	Module's data
 	std::vector<Tree*> levelTrees; ///< The predicting Tree for every level (can be missing)
+	QMutex levelTreesMutex;		///< The lock for #levelTrees (they can be built on demand)
+	std::vector<SearchArena*> freeArenas;	///< The arenas not used by any predictor (owned)
+	QMutex freeArenasMutex;					///< The lock for #freeArenas
 	#ifndef NDEBUG // the stats about the domain counts predicted
 	long predicted, maxpred;
 	#endif
@@ -53,21 +89,33 @@ protected:
 public:
 /**	\name IStdEncPredictor interface
  *	@{ */
+	void prepare( const ISquareDomains::PoolList &pools
+	, const ISquareEncoder::LevelPoolInfos &levelPoolInfos, int minLevel, int maxLevel
+	, bool allowInversion );
 	IOneRangePredictor* newPredictor(const NewPredictorData &data);
 	
 	void cleanUp() {
 		clearContainer(levelTrees);
 		levelTrees.clear();
+		clearContainer(freeArenas);
+		freeArenas.clear();
 	}
 ///	@}
 
 protected:
+	/** Takes a free arena (or creates a new one if there's none), thread-safe */
+	SearchArena* takeArena();
+	/** Returns an \p arena taken by ::takeArena to be reused, thread-safe */
+	void releaseArena(SearchArena *arena);
+
 	/** Computes the level for predictions based on the actual level */
 	int getPredLevel(int /*realLevel*/) const 
 		{ return 2; }
 
-	/** Builds a new tree for one level of range blocks using passed domain blocks */
-	Tree* createTree(const NewPredictorData &data);
+	/** Builds a new tree for range blocks on \p level using passed domain blocks,
+	 *	the work is split into tasks if \p taskPool is nonzero (it has to be the current one) */
+	Tree* createTree( const ISquareDomains::PoolList &pools, const PoolInfos &poolInfos
+	, int level, bool allowInversion, TaskPool *taskPool );
 
 	/** Normalizes and possibly shrinks a domain block */
 	static void refineDomain( const SummedPixels &pixMatrix, int x0, int y0
@@ -115,12 +163,15 @@ protected:
 				return result;
 			}
 		} errorNorm; ///< used to compute SE in the normalized space (from normal SE)
+		float approxCoeff; ///< Multiplies normalized SE bounds, 1/(1+epsilon)^2
 		
 		typedef Tree::PointHeap PointHeap;
 	protected:
-		std::vector<PointHeap*> heaps;	///< Pointers to the heaps for every rotation and inversion
-		std::vector<HeapInfo> infoHeap;	///< Heap built from ::heaps according to their best SEs
-		KDReal *points; ///< Normalized range rotations and inversions used by the heaps (owned)
+		MSaupePredictor &owner;	///< The module that owns the ::arena
+		SearchArena *arena;		/**< The heaps for every rotation and inversion 
+								 *	 and the space for ::points (taken from ::owner) */
+		std::vector<HeapInfo> infoHeap;	///< Heap built from the heaps according to their best SEs
+		KDReal *points; ///< Normalized range rotations and inversions used by the heaps
 		int chunkSize	///  The suggested count for predicted ranges returned at once
 		, predsRemain	///  Max.\ remaining count of predictions to be returned
 		, heapCount;	///< The number of heaps
@@ -128,19 +179,24 @@ protected:
 		, allowRotations///  Like NewPredictorData::allowRotations
 		, isRegular;	///< Indicates regularity of the range block (see RangeNode::isRegular)
 	
-	DEBUG_ONLY( public: long *predicted; )
+	DEBUG_ONLY( public: long predicted; ) ///< Added to the owner's count on destruction
 
 	protected:
 		/** Creates a new predictor for a range block (prepares tree-heaps, etc.) */
-		OneRangePredictor( const NewPredictorData &data, int chunkSize_
-			, const Tree &tree, int maxPredicts );
+		OneRangePredictor( MSaupePredictor &owner_, const NewPredictorData &data
+			, int chunkSize_, const Tree &tree, int maxPredicts, float epsilon );
 	public:
 	/**	\name IOneRangePredictor interface
 	 *	@{ */
 		Predictions& getChunk(float maxPredictedSE,Predictions &store);
 		~OneRangePredictor() {
-			clearContainer(heaps);
-			delete[] points;
+			#ifndef NDEBUG // the owner's stats are shared by concurrent predictors
+			{
+				QMutexLocker locker(&owner.levelTreesMutex);
+				owner.predicted+= predicted;
+			}
+			#endif
+			owner.releaseArena(arena);
 		}
 	///	@}
 	}; // OneRangePredictor class
@@ -16,6 +16,7 @@ int MSquarePixels::createJobs(const PlaneList &planes) {
 		job.height= plSet->height;
 		job.pixels= plane->pixels;
 		job.sumsValid= false;
+		job.compactSums= compactSums();
 		job.settings= plSet;
 		DEBUG_ONLY(	job.ranges= 0; job.domains= 0; job.encoder= 0; )
 	//	append the result to the jobs
@@ -61,6 +62,28 @@ int MSquarePixels::createJobs(const PlaneList &planes) {
 	return jobs.size();
 }
 
+float MSquarePixels::jobCost(int jobIndex) {
+	ASSERT( jobIndex>=0 && jobIndex<jobCount() );
+	const PlaneBlock &job= jobs[jobIndex];
+//	the sums are needed for encoding anyway
+	job.summers_makeValid();
+//	textured parts need more range divisions and domain comparisons than flat ones,
+//	so the pixels are weighted by the deviation of the tile they belong to
+	const int tileSize= 16;
+	const Real devWeight= 16;
+	Real cost= 0;
+	for (int y0=0; y0<job.height; y0+=tileSize)
+		for (int x0=0; x0<job.width; x0+=tileSize) {
+			Block tile( x0, y0, min<int>(x0+tileSize,job.width), min<int>(y0+tileSize,job.height) );
+			int pixCount= tile.size();
+			Real sum, sum2;
+			job.getSums(tile).unpack(sum,sum2);
+			Real dev2= sum2/pixCount - sqr(sum/pixCount);
+			cost+= pixCount * ( 1 + devWeight*sqrt(max<Real>(dev2,0)) );
+		}
+	return cost;
+}
+
 void MSquarePixels::writeSettings(ostream &file) {
 	ASSERT( moduleRanges() && moduleDomains() && moduleEncoder() );
 //	put settings and ID's of child modules
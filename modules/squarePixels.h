@@ -7,7 +7,9 @@
 /// \ingroup modules
 /** A simple shape transformer using square pixels. It allows to choose modules of types
  *	ISquareRanges, ISquareDomains and ISquareEncoder for subsequent coding.
- *	It can split the planes	into rectangles - max.\ size is a parameter. */
+ *	It can split the planes	into rectangles - max.\ size is a parameter.
+ *	The blocks and domain pools can use compact summers (see CompactSummer),
+ *	this setting isn't stored in files. */
 class MSquarePixels: public IShapeTransformer {
 	DECLARE_debugModule;
 
@@ -31,11 +33,16 @@ class MSquarePixels: public IShapeTransformer {
 		label:	"Encoder",
 		desc:	"The module that will find the best Domain-Range mappings",
 		type:	settingModule<ISquareEncoder>()
+	}, {
+		label:	"Compact sums",
+		desc:	"Keep the summed tables of blocks and domain pools in about four times\n"
+				"less memory (the sums are equally precise, but they take longer to compute)",
+		type:	settingCombo("no\nyes",0)
 	} )
 
 protected:
 	/** Indices for settings */
-	enum Settings { MaxPartSize, ModuleRanges, ModuleDomains, ModuleEncoder };
+	enum Settings { MaxPartSize, ModuleRanges, ModuleDomains, ModuleEncoder, CompactSums };
 //	Settings-retrieval methods
 	int& maxPartSize()
 		{ return settingsInt(MaxPartSize); }
@@ -45,6 +52,8 @@ protected:
 		{ return debugCast<ISquareDomains*>(settings[ModuleDomains].m); }
 	ISquareEncoder* moduleEncoder()
 		{ return debugCast<ISquareEncoder*>(settings[ModuleEncoder].m); }
+	int& compactSums()
+		{ return settingsInt(CompactSums); }
 
 	typedef IColorTransformer::Plane Plane;
 	typedef MTypes::PlaneBlock PlaneBlock;
@@ -77,15 +86,16 @@ public:
 		return jobs.size();
 	}
 	
+	float jobCost(int jobIndex);
 	void jobEncode(int jobIndex) {
 		ASSERT( jobIndex>=0 && jobIndex<jobCount() );
 		PlaneBlock &job= jobs[jobIndex];
 		job.encoder->initialize( IRoot::Encode, job );
 		job.ranges->encode(job);
 	}
-	void jobDecodeAct( int jobIndex, DecodeAct action, int count=1 ) {
+	int jobDecodeAct( int jobIndex, DecodeAct action, int count=1 ) {
 		ASSERT( jobIndex>=0 && jobIndex<jobCount() );
-		jobs[jobIndex].encoder->decodeAct(action,count);
+		return jobs[jobIndex].encoder->decodeAct(action,count);
 	}
 
 	void writeSettings(std::ostream &file);
@@ -6,36 +6,201 @@ enum { MinDomSize=8, MinRngSize=4 };
 using namespace std;
 
 
-/** Implementations of shrinking routines by using MatrixWalkers */
+/** Implementations of shrinking routines by using MatrixWalkers, they fill a \p block
+ *	of \p dest (the source coordinates are derived from it) */
 namespace NOSPACE {
 	using namespace MatrixWalkers;
-	/** Performs a simple 50\%^2 image shrink (dimensions belong to the destination)
-	 *	\relates MStdDomains */
-	void shrinkToHalf( CSMatrix src, SMatrix dest, int width, int height ) {
-		walkOperate( Checked<SReal>(dest,Block(0,0,width,height))
-		, HalfShrinker<const SReal>(src), ReverseAssigner() );
+	/** Performs a simple 50\%^2 image shrink \relates MStdDomains */
+	void walkHalf( CSMatrix src, SMatrix dest, const Block &block ) {
+		walkOperate( Checked<SReal>(dest,block)
+		, HalfShrinker<const SReal>(src,2*block.x0,2*block.y0), ReverseAssigner() );
 	}
 	/** Performs a simple 33\%x66\% image horizontal shrink
-	 *	(dimensions belong to the destination) \relates MStdDomains */
-	void shrinkHorizontally( CSMatrix src, SMatrix dest, int width, int height ) {
-		walkOperate( Checked<SReal>(dest,Block(0,0,width,height))
-		, HorizShrinker<const SReal>(src), ReverseAssigner() );
+	 *	(the block has to begin on an even line) \relates MStdDomains */
+	void walkHorizontally( CSMatrix src, SMatrix dest, const Block &block ) {
+		ASSERT( block.y0%2 == 0 );
+		walkOperate( Checked<SReal>(dest,block)
+		, HorizShrinker<const SReal>( src.shiftMatrix(3*block.x0,block.y0/2*3) )
+		, ReverseAssigner() );
 	}
 	/** Performs a simple 66\%x33\% image vertical shrink
-	 *	(dimensions belong to the destination) \relates MStdDomains */
-	void shrinkVertically( CSMatrix src, SMatrix dest, int width, int height ) {
-		walkOperate( Checked<SReal>(dest,Block(0,0,width,height))
-		, VertShrinker<const SReal>(src), ReverseAssigner() );
+	 *	(the block has to begin on an even column) \relates MStdDomains */
+	void walkVertically( CSMatrix src, SMatrix dest, const Block &block ) {
+		ASSERT( block.x0%2 == 0 );
+		walkOperate( Checked<SReal>(dest,block)
+		, VertShrinker<const SReal>( src.shiftMatrix(block.x0/2*3,3*block.y0) )
+		, ReverseAssigner() );
 	}
 	/** Performs 50\% shrink with 45-degree anticlockwise rotation
-	 *	(\p side - the length of the destination square; 
-	 *	\p sx0, \p sy0 - the top-left of the enclosing source square) \relates MStdDomains */
-	void shrinkToDiamond( CSMatrix src, SMatrix dest, int side ) {
-		walkOperate( Checked<SReal>(dest,Block(0,0,side,side))
-		, DiamShrinker<const SReal>(src,side), ReverseAssigner() );
-	}//	shrinkToDiamond
+	 *	(\p side - the length of the whole destination square) \relates MStdDomains */
+	void walkDiamond( CSMatrix src, SMatrix dest, int side, const Block &block ) {
+		walkOperate( Checked<SReal>(dest,block), DiamShrinker<const SReal>
+			( src.shiftMatrix(block.x0-block.y0,block.x0+block.y0), side )
+		, ReverseAssigner() );
+	}
+}
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+
+/** SSE2 implementations of the shrinking routines, they vectorize along the columns
+ *	and give bit-identical results to the MatrixWalkers ones */
+namespace NOSPACE {
+	/** Loads 8 values from \p p and splits them into the even and the odd ones */
+	inline void deinterleave2( const SReal *p, __m128 &even, __m128 &odd ) {
+		__m128 v0= _mm_loadu_ps(p), v1= _mm_loadu_ps(p+4);
+		even=	_mm_shuffle_ps( v0, v1, _MM_SHUFFLE(2,0,2,0) );
+		odd=	_mm_shuffle_ps( v0, v1, _MM_SHUFFLE(3,1,3,1) );
+	}
+	/** Splits 12 values in \p v0, \p v1, \p v2 into three vectors by their index modulo 3 */
+	inline void deinterleave3( __m128 v0, __m128 v1, __m128 v2
+	, __m128 &mod0, __m128 &mod1, __m128 &mod2 ) {
+		mod0= _mm_shuffle_ps( v0, _mm_shuffle_ps(v1,v2,_MM_SHUFFLE(1,0,3,2))
+			, _MM_SHUFFLE(3,0,3,0) );
+		mod1= _mm_shuffle_ps( _mm_shuffle_ps(v0,v1,_MM_SHUFFLE(0,0,1,1))
+			, _mm_shuffle_ps(v1,v2,_MM_SHUFFLE(2,2,3,3)), _MM_SHUFFLE(2,0,2,0) );
+		mod2= _mm_shuffle_ps( _mm_shuffle_ps(v0,v1,_MM_SHUFFLE(1,1,2,2))
+			, _mm_shuffle_ps(v2,v2,_MM_SHUFFLE(3,3,0,0)), _MM_SHUFFLE(2,0,2,0) );
+	}
+	/** Sums triples of consecutive values (from 12 ones beginning on \p p) */
+	inline __m128 sumTriples(const SReal *p) {
+		__m128 mod0, mod1, mod2;
+		deinterleave3( _mm_loadu_ps(p), _mm_loadu_ps(p+4), _mm_loadu_ps(p+8), mod0, mod1, mod2 );
+		return _mm_add_ps( _mm_add_ps(mod0,mod1), mod2 );
+	}
+	/** Computes (2*\p full + \p half) / 9 in Real precision like the 3x3 shrinkers */
+	inline __m128 weightThirds( __m128 full, __m128 half ) {
+		const __m128d ninth= _mm_set1_pd( Real(1.0/9.0) );
+		__m128d fullLo= _mm_cvtps_pd(full), halfLo= _mm_cvtps_pd(half)
+		, fullHi= _mm_cvtps_pd(_mm_movehl_ps(full,full))
+		, halfHi= _mm_cvtps_pd(_mm_movehl_ps(half,half));
+		__m128d lo= _mm_mul_pd( _mm_add_pd(_mm_add_pd(fullLo,fullLo),halfLo), ninth )
+		, hi= _mm_mul_pd( _mm_add_pd(_mm_add_pd(fullHi,fullHi),halfHi), ninth );
+		return _mm_movelh_ps( _mm_cvtpd_ps(lo), _mm_cvtpd_ps(hi) );
+	}
+	/** The scalar version of ::weightThirds */
+	inline SReal weightThirds( Real full, Real half )
+		{ return (ldexp(full,1)+half) * Real(1.0/9.0); }
+
+	/** SSE2 version of ::walkHalf */
+	void shrinkBlockToHalf( CSMatrix src, SMatrix dest, const Block &block ) {
+		const __m128 quarter= _mm_set1_ps(0.25f);
+		for (int x=block.x0; x<block.xend; ++x) {
+			const SReal *s0= src[2*x], *s1= src[2*x+1];
+			SReal *d= dest[x];
+			int y= block.y0;
+			for (; y+4<=block.yend; y+=4) {
+				__m128 even0, odd0, even1, odd1;
+				deinterleave2( s0+2*y, even0, odd0 );
+				deinterleave2( s1+2*y, even1, odd1 );
+				__m128 sum= _mm_add_ps( _mm_add_ps( _mm_add_ps(even0,odd0), even1 ), odd1 );
+				_mm_storeu_ps( d+y, _mm_mul_ps(sum,quarter) );
+			}
+			for (; y<block.yend; ++y)
+				d[y]= ldexp( s0[2*y] + s0[2*y+1] + s1[2*y] + s1[2*y+1], -2 );
+		}
+	}
+	/** SSE2 version of ::walkHorizontally */
+	void shrinkBlockHorizontally( CSMatrix src, SMatrix dest, const Block &block ) {
+		ASSERT( block.y0%2 == 0 );
+		for (int x=block.x0; x<block.xend; ++x) {
+			const SReal *s0= src[3*x], *s1= src[3*x+1], *s2= src[3*x+2];
+			SReal *d= dest[x];
+			int y= block.y0;
+		//	eight lines are made from twelve lines at once
+			for (; y+8<=block.yend; y+=8) {
+				int r= y/2*3;
+				__m128 lines[3];
+				for (int i=0; i<3; ++i, r+=4)
+					lines[i]= _mm_add_ps( _mm_add_ps( _mm_loadu_ps(s0+r), _mm_loadu_ps(s1+r) )
+						, _mm_loadu_ps(s2+r) );
+				__m128 mod0, mod1, mod2;
+				deinterleave3( lines[0], lines[1], lines[2], mod0, mod1, mod2 );
+				__m128 even= weightThirds(mod0,mod1), odd= weightThirds(mod2,mod1);
+				_mm_storeu_ps( d+y, _mm_unpacklo_ps(even,odd) );
+				_mm_storeu_ps( d+y+4, _mm_unpackhi_ps(even,odd) );
+			}
+			for (; y<block.yend; ++y) {
+				int r= y/2*3 + y%2; // the first line used
+				Real first= s0[r] + s1[r] + s2[r];
+				++r;
+				Real second= s0[r] + s1[r] + s2[r];
+				d[y]= y%2 ? weightThirds(second,first) : weightThirds(first,second);
+			}
+		}
+	}
+	/** SSE2 version of ::walkVertically */
+	void shrinkBlockVertically( CSMatrix src, SMatrix dest, const Block &block ) {
+		ASSERT( block.x0%2 == 0 );
+	//	two columns are made from three columns at once
+		for (int x=block.x0; x<block.xend; x+=2) {
+			int c= x/2*3;
+			bool both= x+1 < block.xend; // the second column is to be made, too
+			const SReal *s0= src[c], *s1= src[c+1], *s2= both ? src[c+2] : 0;
+			SReal *d0= dest[x], *d1= both ? dest[x+1] : 0;
+			int y= block.y0;
+			for (; y+4<=block.yend; y+=4) {
+				__m128 half= sumTriples(s1+3*y);
+				_mm_storeu_ps( d0+y, weightThirds( sumTriples(s0+3*y), half ) );
+				if (both)
+					_mm_storeu_ps( d1+y, weightThirds( sumTriples(s2+3*y), half ) );
+			}
+			for (; y<block.yend; ++y) {
+				const int r= 3*y;
+				Real half= s1[r] + s1[r+1] + s1[r+2];
+				d0[y]= weightThirds( s0[r] + s0[r+1] + s0[r+2], half );
+				if (both)
+					d1[y]= weightThirds( s2[r] + s2[r+1] + s2[r+2], half );
+			}
+		}
+	}
+	/** Loads the pairs of values on \p p0, \p p1, \p p2, \p p3
+	 *	and splits them into the first and the second ones */
+	inline void loadPairs( const SReal *p0, const SReal *p1, const SReal *p2, const SReal *p3
+	, __m128 &first, __m128 &second ) {
+		__m128 v01= _mm_loadh_pi( _mm_loadl_pi(_mm_setzero_ps(),(const __m64*)p0), (const __m64*)p1 )
+		, v23= _mm_loadh_pi( _mm_loadl_pi(_mm_setzero_ps(),(const __m64*)p2), (const __m64*)p3 );
+		first=	_mm_shuffle_ps( v01, v23, _MM_SHUFFLE(2,0,2,0) );
+		second=	_mm_shuffle_ps( v01, v23, _MM_SHUFFLE(3,1,3,1) );
+	}
+	/** SSE2 version of ::walkDiamond, four pixels of a column are made from
+	 *	2x2 squares on a diagonal of \p src at once */
+	void shrinkBlockToDiamond( CSMatrix src, SMatrix dest, int side, const Block &block ) {
+		const __m128 quarter= _mm_set1_ps(0.25f);
+		const PtrInt diagSkip= 1-src.colSkip;
+	//	the pixel [i,j] is made from the 2x2 square on [side-1+i-j,i+j]
+		for (int i=block.x0; i<block.xend; ++i) {
+			SReal *d= dest[i];
+			const SReal *s= src[side-1+i-block.y0] + i+block.y0;
+			int j= block.y0;
+			for (; j+4<=block.yend; j+=4, s+=4*diagSkip) {
+				__m128 a, b, c, e;
+				loadPairs( s, s+diagSkip, s+2*diagSkip, s+3*diagSkip, a, b );
+				const SReal *t= s+src.colSkip;
+				loadPairs( t, t+diagSkip, t+2*diagSkip, t+3*diagSkip, c, e );
+				__m128 sum= _mm_add_ps( _mm_add_ps( _mm_add_ps(a,b), c ), e );
+				_mm_storeu_ps( d+j, _mm_mul_ps(sum,quarter) );
+			}
+			for (; j<block.yend; ++j, s+=diagSkip)
+				d[j]= ldexp( s[0] + s[1] + s[src.colSkip] + s[src.colSkip+1], -2 );
+		}
+	}
+}
+
+#else // no SSE2 -> use the MatrixWalkers
+
+namespace NOSPACE {
+	inline void shrinkBlockToHalf( CSMatrix src, SMatrix dest, const Block &block )
+		{ walkHalf(src,dest,block); }
+	inline void shrinkBlockHorizontally( CSMatrix src, SMatrix dest, const Block &block )
+		{ walkHorizontally(src,dest,block); }
+	inline void shrinkBlockVertically( CSMatrix src, SMatrix dest, const Block &block )
+		{ walkVertically(src,dest,block); }
+	inline void shrinkBlockToDiamond( CSMatrix src, SMatrix dest, int side, const Block &block )
+		{ walkDiamond(src,dest,side,block); }
 }
 
+#endif // __SSE2__
 
 namespace NOSPACE {
 	/** Pool ordering according to Pool::type (primary key) and Pool::level (secondary) */
@@ -100,9 +265,17 @@ void MStdDomains::initPools(const PlaneBlock &planeBlock) {
 		}
 //	sort the pools according to their types and levels (stable so the diamonds can't be swapped)
 	stable_sort( pools.begin(), pools.end(), PoolTypeLevelComparator() );
+//	the pools use the same kind of summers as the plane block
+	for (PoolList::iterator it=pools.begin(); it!=pools.end(); ++it)
+		it->compactSums= planeBlock.compactSums;
+//	the whole pools are filled by default
+	setNeededRegions( vector<Block>() );
 }
 
 namespace NOSPACE {
+	/** Returns whether \p block contains any pixel */
+	inline static bool isNonempty(const Block &block)
+		{ return block.x0<block.xend && block.y0<block.yend; }
 	typedef MStdDomains::PoolList::const_iterator PoolIt;
 	/** To be called before creating shrinked domains to check the shrink is OK (debug only) */
 	static inline bool halfShrinkOK(PoolIt src,PoolIt dest,int zoom) {
@@ -127,20 +300,23 @@ void MStdDomains::fillPixelsInPools(PlaneBlock &planeBlock) {
 	//	we've got the interval, find out about the type
 		if (type!=DomPortion_Diamond) {
 		//	non-diamond domains all behave similarly
-			void (*shrinkProc)( CSMatrix , SMatrix , int, int );
+			void (*shrinkProc)( CSMatrix , SMatrix , const Block & );
 			switch (type) {
-				case DomPortion_Standard:	shrinkProc= &shrinkToHalf;		break;
-				case DomPortion_Horiz:		shrinkProc= &shrinkHorizontally;break;
-				case DomPortion_Vert:		shrinkProc= &shrinkVertically;	break;
+				case DomPortion_Standard:	shrinkProc= &shrinkBlockToHalf;		break;
+				case DomPortion_Horiz:		shrinkProc= &shrinkBlockHorizontally;break;
+				case DomPortion_Vert:		shrinkProc= &shrinkBlockVertically;	break;
 				default: ASSERT(false), shrinkProc=0;
 			}
 		//	we have the right procedure -> fill the first pool
 			ASSERT( begin->level == 1 );
-			shrinkProc( planeBlock.pixels, begin->pixels, begin->width, begin->height );
+			const Block *region= &neededRegions[begin-pools.begin()];
+			if ( isNonempty(*region) )
+				shrinkProc( planeBlock.pixels, begin->pixels, *region );
 		//	fill the rest (in the same-type interval)
 			while (++begin != end) {
 				ASSERT( halfShrinkOK(begin-1,begin,zoom) );
-				shrinkToHalf( (begin-1)->pixels, begin->pixels, begin->width, begin->height );
+				if ( isNonempty(*++region) )
+					shrinkBlockToHalf( (begin-1)->pixels, begin->pixels, *region );
 			}
 
 		} else { //	handle diamond-type domains
@@ -150,10 +326,12 @@ void MStdDomains::fillPixelsInPools(PlaneBlock &planeBlock) {
 			int shift= lShift( getDiamondShift(min(width,height)), zoom );
 			int longerEnd= lShift( max(width,height)-minSizeNeededForDiamond(), zoom );
 			CSMatrix source= planeBlock.pixels; 
+			const Block *region= &neededRegions[it-pools.begin()];
 			
-			for (int l=0; l<=longerEnd; ++it,l+=shift) {
+			for (int l=0; l<=longerEnd; ++it,++region,l+=shift) {
 				ASSERT( it!=end && it->level==1 && it->width==it->height );
-				shrinkToDiamond( planeBlock.pixels, it->pixels, it->width );
+				if ( isNonempty(*region) )
+					shrinkBlockToDiamond( planeBlock.pixels, it->pixels, it->width, *region );
 				source.shiftMatrix( (horiz?shift:0), (horiz?0:shift) );
 			}
 		//	now fill the multiscaled diamond pools
@@ -162,9 +340,11 @@ void MStdDomains::fillPixelsInPools(PlaneBlock &planeBlock) {
 				while ( min(begin->width,begin->height) < 2*MinDomSize )
 					++begin;
 				ASSERT( halfShrinkOK(begin,it,zoom) );
-				shrinkToHalf( begin->pixels, it->pixels, it->width, it->height );
+				if ( isNonempty(*region) )
+					shrinkBlockToHalf( begin->pixels, it->pixels, *region );
 			//	move on
 				++it;
+				++region;
 				++begin;
 			}
 		}//	if non-diamond else diamond
@@ -177,6 +357,179 @@ void MStdDomains::fillPixelsInPools(PlaneBlock &planeBlock) {
 	//for_each( pools, mem_fun_ref(&Pool::summers_makeValid) );
 }//	::fillPixelsInPools
 
+namespace NOSPACE {
+	/** Returns the floor of \p n/2 (also for negative numbers) */
+	inline static int floorHalf(int n)
+		{ return n>=0 ? n/2 : -((1-n)/2); }
+	/** Clips \p block to \p bounds, returns whether it's nonempty */
+	inline static bool clipToBlock(Block &block,const Block &bounds) {
+		block.x0= max(block.x0,bounds.x0);
+		block.y0= max(block.y0,bounds.y0);
+		block.xend= min(block.xend,bounds.xend);
+		block.yend= min(block.yend,bounds.yend);
+		return isNonempty(block);
+	}
+	/** Clips \p block to the dimensions of \p pool, returns whether it's nonempty */
+	inline static bool clipToPool(Block &block,const MStdDomains::Pool &pool)
+		{ return clipToBlock( block, Block(0,0,pool.width,pool.height) ); }
+
+//	The blocks of pools depending on a changed block of the source (not clipped)
+	/** For ::shrinkBlockToHalf */
+	inline static Block halfShrinkBlock(const Block &b)
+		{ return Block( b.x0/2, b.y0/2, (b.xend+1)/2, (b.yend+1)/2 ); }
+	/** For ::shrinkBlockHorizontally, the y-coordinates are aligned to 3-line groups */
+	inline static Block horizShrinkBlock(const Block &b)
+		{ return Block( b.x0/3, b.y0/3*2, (b.xend+2)/3, (b.yend+2)/3*2 ); }
+	/** For ::shrinkBlockVertically, the x-coordinates are aligned to 3-column groups */
+	inline static Block vertShrinkBlock(const Block &b)
+		{ return Block( b.x0/3*2, b.y0/3, (b.xend+2)/3*2, (b.yend+2)/3 ); }
+	/** For ::shrinkBlockToDiamond (bounding box), \p side is the side of the diamond pool */
+	inline static Block diamondShrinkBlock(const Block &b,int side) {
+	//	the pixel [i,j] is made from the 2x2 square on [side-1+i-j,i+j]
+		int dMin= b.x0-side, dMax= b.xend-side	// the range of i-j
+		, sMin= b.y0-1, sMax= b.yend-1;			// the range of i+j
+		return Block( floorHalf(dMin+sMin), floorHalf(sMin-dMax)
+			, floorHalf(dMax+sMax)+1, floorHalf(sMax-dMin)+1 );
+	}
+}
+void MStdDomains::setNeededRegions(const vector<Block> &regions) {
+	if ( regions.empty() ) { // whole pools
+		neededRegions.resize( pools.size() );
+		for (int i=0; i<(int)pools.size(); ++i)
+			neededRegions[i]= Block( 0, 0, pools[i].width, pools[i].height );
+		return;
+	}
+	ASSERT( regions.size() == pools.size() );
+	neededRegions= regions;
+//	find the pools the others are made from (paired like in ::fillPixelsInPools)
+	vector<int> sources( pools.size(), -1 );
+	PoolList::iterator end= pools.begin();
+	while ( end != pools.end() ) {
+		PoolList::iterator begin= end;
+		char type= begin->type;
+		while ( end!=pools.end() && end->type==type )
+			++end;
+		if (type!=DomPortion_Diamond) {
+			for (PoolList::iterator it=begin+1; it!=end; ++it)
+				sources[it-pools.begin()]= it-1-pools.begin();
+		} else {
+			PoolList::iterator it= begin;
+			while ( it!=end && it->level==1 )
+				++it;
+			for (; it!=end; ++it,++begin) {
+				while ( min(begin->width,begin->height) < 2*MinDomSize )
+					++begin;
+				sources[it-pools.begin()]= begin-pools.begin();
+			}
+		}
+	}
+//	extend the regions by the parts needed to make the more downscaled pools
+//	(the sources always precede, so one backward pass suffices)
+	for (int i=(int)pools.size()-1; i>=0; --i) {
+		const Block &region= neededRegions[i];
+		int src= sources[i];
+		if ( src<0 || !isNonempty(region) )
+			continue;
+		Block block( 2*region.x0, 2*region.y0, 2*region.xend, 2*region.yend );
+		clipToPool(block,pools[src]);
+		Block &srcRegion= neededRegions[src];
+		if ( isNonempty(srcRegion) ) {
+			srcRegion.x0= min(srcRegion.x0,block.x0);
+			srcRegion.y0= min(srcRegion.y0,block.y0);
+			srcRegion.xend= max(srcRegion.xend,block.xend);
+			srcRegion.yend= max(srcRegion.yend,block.yend);
+		} else
+			srcRegion= block;
+	}
+//	the horizontal and vertical shrinks make pixel pairs from triples
+	for (int i=0; i<(int)pools.size(); ++i) {
+		Block &region= neededRegions[i];
+		if (pools[i].level==1 && pools[i].type==DomPortion_Horiz)
+			region.y0-= region.y0%2;
+		if (pools[i].level==1 && pools[i].type==DomPortion_Vert)
+			region.x0-= region.x0%2;
+	}
+}
+
+void MStdDomains::refreshPixelsInPools(PlaneBlock &planeBlock,const Block &changed) {
+	ASSERT( !pools.empty() ); // assuming the pools have already been filled
+//	iterate over pool types (like in ::fillPixelsInPools)
+	PoolList::iterator end= pools.begin();
+	while ( end != pools.end() ) {
+		PoolList::iterator begin= end;
+		char type= begin->type;
+	//	find the end of the same-pool-type block
+		while ( end!=pools.end() && end->type==type )
+			++end;
+
+		if (type!=DomPortion_Diamond) {
+		//	find out the changed block of the first pool and refresh it
+			Block block;
+			switch (type) {
+				case DomPortion_Standard:	block= halfShrinkBlock(changed);	break;
+				case DomPortion_Horiz:		block= horizShrinkBlock(changed);	break;
+				case DomPortion_Vert:		block= vertShrinkBlock(changed);	break;
+				default: ASSERT(false);
+			}
+			const Block *region= &neededRegions[begin-pools.begin()];
+			if ( !clipToBlock(block,*region) )
+				continue;
+			begin->summers_invalidate();
+			switch (type) {
+				case DomPortion_Standard:
+					shrinkBlockToHalf( planeBlock.pixels, begin->pixels, block );			break;
+				case DomPortion_Horiz:
+					shrinkBlockHorizontally( planeBlock.pixels, begin->pixels, block );	break;
+				case DomPortion_Vert:
+					shrinkBlockVertically( planeBlock.pixels, begin->pixels, block );	break;
+			}
+		//	refresh the more downscaled pools (in the same-type interval)
+			while ( ++begin != end ) {
+				block= halfShrinkBlock(block);
+				if ( !clipToBlock(block,*++region) )
+					break;
+				begin->summers_invalidate();
+				shrinkBlockToHalf( (begin-1)->pixels, begin->pixels, block );
+			}
+
+		} else { //	handle diamond-type domains
+		//	the changed blocks of the pools in the interval (empty if unchanged)
+			vector<Block> blocks;
+			blocks.reserve(end-begin);
+			PoolList::iterator first= begin
+			, it= begin; //< the currently refreshed domain pool
+			const Block *region= &neededRegions[it-pools.begin()]; //< the region of *it
+		//	refresh the first set of diamond-type domain pools
+			for (; it!=end && it->level==1; ++it,++region) {
+				Block block= diamondShrinkBlock(changed,it->width);
+				if ( clipToBlock(block,*region) ) {
+					it->summers_invalidate();
+					shrinkBlockToDiamond( planeBlock.pixels, it->pixels, it->width, block );
+				} else
+					block.xend= block.x0;
+				blocks.push_back(block);
+			}
+		//	now refresh the multiscaled diamond pools (paired like in ::fillPixelsInPools)
+			while (it!=end) {
+				while ( min(begin->width,begin->height) < 2*MinDomSize )
+					++begin;
+				Block srcBlock= blocks[begin-first]
+				, block= halfShrinkBlock(srcBlock);
+				if ( srcBlock.x0<srcBlock.xend && clipToBlock(block,*region) ) {
+					it->summers_invalidate();
+					shrinkBlockToHalf( begin->pixels, it->pixels, block );
+				} else
+					block.xend= block.x0;
+				blocks.push_back(block);
+			//	move on
+				++it;
+				++region;
+				++begin;
+			}
+		}//	if non-diamond else diamond
+	}//	for (iterate over single-type intervals)
+}//	::refreshPixelsInPools
+
 namespace NOSPACE {
 	/** Computes the ideal domain density for pool, level and max.\ domain count,
 	 *	the density is push_back-ed, returns the generated domain count (used once)
@@ -55,6 +55,8 @@ protected:
 //	Module's data
 	/// The list of domain pools, pool IDs are the indices, the Pool::pixels are owned
 	PoolList pools;
+	/// The regions of #pools to fill (including the parts needed to make the other pools)
+	std::vector<Block> neededRegions;
 	int width	///  Width of the original image (not zoomed)
 	, height	///  Height of the original image (not zoomed)
 	, zoom;		///< the zoom
@@ -74,6 +76,8 @@ public:
  *	@{ */
 	void initPools(const PlaneBlock &planeBlock);
 	void fillPixelsInPools(PlaneBlock &planeBlock);
+	void refreshPixelsInPools(PlaneBlock &planeBlock,const Block &changed);
+	void setNeededRegions(const std::vector<Block> &regions);
 
 	const PoolList& getPools() const
 		{ return pools; }
@@ -1,7 +1,11 @@
 #include <memory> // auto_ptr
+#ifdef __SSE2__
+	#include <emmintrin.h>
+#endif
 
 #include "stdEncoder.h"
 #include "../fileUtil.h"
+#include "../threadUtil.h"
 
 using namespace std;
 
@@ -94,29 +98,114 @@ inline static Block adjustDomainForIncompleteRange( Block range, int rotation, B
 	return domain;
 }
 
+namespace NOSPACE {
+	/** Fills a part of a summer as a task in TaskPool - the columns [begin,end)
+	 *	in the first phase, the rows [begin,end) in the second one */
+	class SummerPartTask: public QRunnable {
+		SummedPixels::BSummer summer;	///< the (shifted) summer being filled
+		SMatrix pixels;					///< the (shifted) pixels to sum
+		int width, height				///  the dimensions of the summed region
+		, begin, end;					///< the range of columns or rows
+		bool rows;						///< whether it's the second phase
+	public:
+		/** Only initializes the members */
+		SummerPartTask( const SummedPixels::BSummer &summer_, SMatrix pixels_
+		, int width_, int height_, int begin_, int end_, bool rows_ )
+		: summer(summer_), pixels(pixels_), width(width_), height(height_)
+		, begin(begin_), end(end_), rows(rows_) {}
+		/** Fills the part (virtual method) */
+		void run() {
+			if (rows)
+				summer.fillRows( width, begin, end );
+			else
+				summer.fillColumns( pixels, begin, end, height );
+		}
+	};
+
+	/** The minimal number of pixels of a block whose summers are filled by more tasks */
+	const int MinParallelSumsSize= 1<<18;
+
+	/** Validates the summers of \p pixels like SummedMatrix::summers_makeValid, but only
+	 *	the sums of blocks within \p region are valid then (recorded in sumsRegion; the compact
+	 *	summers are always filled whole), the filling of large regions is split among
+	 *	the tasks of the current TaskPool */
+	void makeRegionSumsValid(const SummedPixels &pixels,const Block &region) {
+		if ( pixels.sumsValid && pixels.sumsRegion.contains(region) )
+			return;
+		if (pixels.compactSums) {
+			pixels.summers_makeValid();
+			return;
+		}
+		SummedPixels::BSummer summer= pixels.summer;
+		summer.prepare( pixels.width, pixels.height );
+		constCast(pixels.summer)= summer;
+	//	the sums relative to the region's corner give the same block sums within the region
+		summer.sums.shiftMatrix( region.x0, region.y0 );
+		SMatrix inp= pixels.pixels;
+		inp.shiftMatrix( region.x0, region.y0 );
+		int width= region.width(), height= region.height();
+
+		TaskPool *taskPool= TaskPool::current();
+		int parts= taskPool ? taskPool->threadCount() : 1;
+		if ( parts<2 || width*height < MinParallelSumsSize )
+			summer.fill( inp, width, height );
+		else
+		//	sum the columns and then the rows, every phase split into equal parts
+			for (int phase=0; phase<2; ++phase) {
+				int length= phase ? height : width;
+				TaskGroup group;
+				for (int i=0; i<parts; ++i)
+					taskPool->start( new SummerPartTask( summer, inp, width, height
+						, length*i/parts, length*(i+1)/parts, phase ), group );
+				taskPool->wait(group);
+				checkThrow( !group.hasFailed() );
+			}
+		constCast(pixels.sumsValid)= true;
+		constCast(pixels.sumsRegion)= region;
+	}
+	/** Validates the summers of whole \p pixels, see ::makeRegionSumsValid */
+	void makeSumsValid(const SummedPixels &pixels)
+		{ makeRegionSumsValid( pixels, Block(0,0,pixels.width,pixels.height) ); }
+}
+
 ////	Member methods
 
 void MStdEncoder::initialize( IRoot::Mode mode, PlaneBlock &planeBlock_ ) {
 	planeBlock= &planeBlock_;
 //	prepare the domains-module
 	planeBlock->domains->initPools(*planeBlock);
+	poolsFilled= false;
 
 	int maxLevel= 1 +log2ceil(max( planeBlock->width, planeBlock->height ));
-//	prepare levelPoolInfos
+//	prepare levelPoolInfos and levelDomainStats
 	levelPoolInfos.resize(maxLevel);
+	levelDomainStats.resize(maxLevel);
 
 	if (mode==IRoot::Encode) {
 		typedef ISquareDomains::PoolList PoolList;
 	//	prepare the domains
 		planeBlock->domains->fillPixelsInPools(*planeBlock);
-		for_each( planeBlock->domains->getPools(), mem_fun_ref(&Pool::summers_makeValid) );
+		for_each( planeBlock->domains->getPools(), makeSumsValid );
 	//	initialize the range summers
-		planeBlock->summers_makeValid();
+		makeSumsValid(*planeBlock);
 
 	//	prepare maximum SquareErrors allowed for regular range blocks
 		stdRangeSEs.resize(maxLevel+1);
 		planeBlock->settings->moduleQ2SE->regularRangeErrors
 			( planeBlock->settings->quality, maxLevel+1, &stdRangeSEs.front() );
+	//	build the pool infos and domain statistics for all the levels the ranges can have
+	//	now, so findBestSE can be called concurrently
+		int minRangeLevel, maxRangeLevel;
+		planeBlock->ranges->getLevelSpan(minRangeLevel,maxRangeLevel);
+		minRangeLevel= max(minRangeLevel,2);
+		maxRangeLevel= min(maxRangeLevel,maxLevel-1);
+		for (int level=minRangeLevel; level<=maxRangeLevel; ++level) {
+			buildPoolInfos4aLevel(level);
+			fillDomainStats(level,false);
+		}
+	//	let the predictor prepare for the levels (e.g. build its structures in parallel)
+		modulePredictor()->prepare( planeBlock->domains->getPools(), levelPoolInfos
+		, minRangeLevel, maxRangeLevel, settingsInt(AllowedInversion) );
 	}
 }
 
@@ -160,6 +249,63 @@ const ISquareDomains::Pool& MStdEncoder::getDomainData
 	return pool;
 }
 
+namespace NOSPACE {
+	/** Offsets (in multiples of the smaller side) of the seed domains for a range from
+	 *	the domain of a related range, indexed by the relation (see ::getRelatedSeeds):
+	 *	the parent's quadrants, the son's containing domains, the neighbour's domain
+	 *	and its shifts */
+	const struct { int count; signed char offsets[5][2]; } seedOffsets[3]= {
+		{ 4, { {0,0}, {1,0}, {0,1}, {1,1} } },
+		{ 4, { {0,0}, {-1,0}, {0,-1}, {-1,-1} } },
+		{ 5, { {0,0}, {-1,0}, {1,0}, {0,-1}, {0,1} } }
+	};
+}
+void MStdEncoder::getRelatedSeeds( const RangeNode &range, const RangeList &seedRanges
+, IStdEncPredictor::Predictions &seeds ) const {
+	seeds.clear();
+	const PoolInfos &poolInfos= levelPoolInfos[range.level];
+	int side= powers[range.level];
+	for (RangeList::const_iterator sit=seedRanges.begin(); sit!=seedRanges.end(); ++sit) {
+		const RangeNode &related= **sit;
+	//	the related range has to be a regular range mapped to a domain
+	//	on an initialized level (a parent, a son or a neighbour of the same size)
+		const RangeInfo *relInfo= static_cast<const RangeInfo*>(related.encoderData);
+		int relation= related.level==range.level+1 ? 0
+			: ( related.level==range.level-1 ? 1 : ( related.level==range.level ? 2 : -1 ) );
+		if ( relation<0 || !relInfo || relInfo->domainID<0 || !related.isRegular()
+		|| related.level >= (int)levelDomainStats.size()
+		|| relInfo->domainID >= levelDomainStats[related.level].size() )
+			continue;
+		const DomainStats &relStats= levelDomainStats[related.level];
+		const Pool *pool= relStats.pools[relInfo->domainID];
+		const Block &relDomain= relStats.blocks[relInfo->domainID];
+	//	find the info of the domain's pool on the range's level
+		PoolInfos::const_iterator it= poolInfos.begin()
+			+ ( pool - &planeBlock->domains->getPools().front() );
+		int density= it->density;
+		if ( density<=0 || (it+1)->indexBegin <= it->indexBegin )
+			continue; // no domains in the pool on this level
+		int domsInCol= getCountForDensity( pool->height, density, side );
+		int domsInRow= ( (it+1)->indexBegin - it->indexBegin ) / domsInCol;
+		int step= relation==1 ? side/2 : side;
+	//	find the nearest domain for every offset, the rotation is kept
+		IStdEncPredictor::Prediction seed;
+		seed.rotation= relInfo->rotation;
+		for (int i=0; i<seedOffsets[relation].count; ++i) {
+			const signed char *offset= seedOffsets[relation].offsets[i];
+			int x= relDomain.x0 + offset[0]*step, y= relDomain.y0 + offset[1]*step;
+			int col= checkBoundsFunc( 0, (x+density/2)/density, domsInRow-1 )
+			, row= checkBoundsFunc( 0, (y+density/2)/density, domsInCol-1 );
+			seed.domainID= it->indexBegin + col*domsInCol + row;
+			bool isNew= true;
+			for (int j=0; j<(int)seeds.size(); ++j)
+				isNew= isNew && seeds[j].domainID!=seed.domainID;
+			if (isNew)
+				seeds.push_back(seed);
+		}
+	}
+}
+
 
 namespace NOSPACE {
 	typedef IStdEncPredictor::NewPredictorData StableInfo;
@@ -183,24 +329,158 @@ namespace NOSPACE {
 	};
 } // namespace NOSPACE
 
+/** Computing the sums of products of a range block with a domain block in all the eight
+ *	rotations at once (for regular ranges) \relates MStdEncoder */
+namespace NOSPACE {
+	/** The minimal number of consecutive predictions of one domain to compute its products
+	 *	for all the rotations at once (::rotationProducts costs about three single products) */
+	enum { MinBatchedPredictions=3 };
+	/** The maximal number of predictions compared at once by EncodingInfo::exactCompare */
+	enum { MaxComparedBatch=64 };
+
+	/** The number of stripes (of domain columns) after which an early termination
+	 *	of a comparison is considered (see EncodingInfo::stripedProduct) */
+	enum { StripeCount=4 };
+	/** The minimal side of a range block for which the comparisons are done in stripes
+	 *	(for smaller blocks the bounds cost more than they can save) */
+	enum { MinStripedSide=8 };
+
+	/** For every rotation: the index of the layout (see ::makeRotationLayouts) and whether
+	 *	the domain's column x is multiplied by the layout's column n-1-x (instead of x) */
+	const struct { char layout; bool mirrored; } rotationColumns[8]= {
+		{0,false}, {2,false}, {2,true}, {0,true}, {1,true}, {3,true}, {3,false}, {1,false}
+	};
+
+	/** Fills \p layouts with the \p n x \p n square \p block of \p pixels in four column-major
+	 *	layouts: as it is, with reversed columns, transposed and transposed with reversed columns.
+	 *	The sums of values and then the sums of squares of all the 4*n columns follow
+	 *	(in the same order). */
+	void makeRotationLayouts( CSMatrix pixels, const Block &block, vector<Real> &layouts ) {
+		int n= block.width(), n2= n*n;
+		ASSERT( block.height()==n );
+		layouts.resize(4*n2+8*n);
+		Real *plain= &layouts[0], *reversed= plain+n2, *transposed= reversed+n2
+		, *transRev= transposed+n2, *colSums= transRev+n2, *colSums2= colSums+4*n;
+		for (int x=0; x<n; ++x) {
+			const SReal *col= pixels[block.x0+x]+block.y0;
+			for (int y=0; y<n; ++y) {
+				plain[x*n+y]= reversed[x*n+n-1-y]= transposed[y*n+x]= transRev[y*n+n-1-x]
+				= col[y];
+			}
+		}
+		for (int col=0; col<4*n; ++col) {
+			colSums[col]= colSums2[col]= 0;
+			for (const Real *it=plain+col*n; it!=plain+(col+1)*n; ++it) {
+				colSums[col]+= *it;
+				colSums2[col]+= sqr(*it);
+			}
+		}
+	}
+
+	/** Returns the sum of products of \p n values on \p dom and \p col */
+	inline Real columnProduct( const SReal *dom, const Real *col, int n ) {
+		#ifdef __SSE2__
+		if (n%4==0) {
+			__m128d acc= _mm_setzero_pd();
+			for (int y=0; y<n; y+=4) {
+				__m128 d= _mm_loadu_ps(dom+y);
+				acc= _mm_add_pd( acc, _mm_add_pd
+					( _mm_mul_pd( _mm_cvtps_pd(d), _mm_loadu_pd(col+y) )
+					, _mm_mul_pd( _mm_cvtps_pd(_mm_movehl_ps(d,d)), _mm_loadu_pd(col+y+2) ) ) );
+			}
+			double pair[2];
+			_mm_storeu_pd(pair,acc);
+			return pair[0]+pair[1];
+		}
+		#endif
+		Real result= 0;
+		for (int y=0; y<n; ++y)
+			result+= dom[y]*col[y];
+		return result;
+	}
+	
+	/** Computes the sums of products of the range (prepared by ::makeRotationLayouts in
+	 *	\p layouts) and the \p domBlock of \p domPixels, for all the rotations at once
+	 *	(\p sums are indexed like rotations in MatrixWalkers::walkOperateCheckRotate) */
+	void rotationProducts( const Real *layouts, CSMatrix domPixels, const Block &domBlock
+	, Real sums[8] ) {
+		int n= domBlock.width(), n2= n*n;
+		ASSERT( domBlock.height()==n );
+		const Real *cols[8];
+	//	the domain's column x is multiplied by the columns of the layouts in cols
+		#ifdef __SSE2__
+		if (n%4==0) {
+			__m128d acc[8];
+			for (int r=0; r<8; ++r)
+				acc[r]= _mm_setzero_pd();
+			for (int x=0; x<n; ++x) {
+				const SReal *dom= domPixels[domBlock.x0+x]+domBlock.y0;
+				for (int r=0; r<8; ++r)
+					cols[r]= layouts + rotationColumns[r].layout*n2
+						+ ( rotationColumns[r].mirrored ? n-1-x : x )*n;
+				for (int y=0; y<n; y+=4) {
+					__m128 d= _mm_loadu_ps(dom+y);
+					__m128d dLo= _mm_cvtps_pd(d), dHi= _mm_cvtps_pd(_mm_movehl_ps(d,d));
+					for (int r=0; r<8; ++r)
+						acc[r]= _mm_add_pd( acc[r], _mm_add_pd
+							( _mm_mul_pd( dLo, _mm_loadu_pd(cols[r]+y) )
+							, _mm_mul_pd( dHi, _mm_loadu_pd(cols[r]+y+2) ) ) );
+				}
+			}
+			for (int r=0; r<8; ++r) {
+				double pair[2];
+				_mm_storeu_pd(pair,acc[r]);
+				sums[r]= pair[0]+pair[1];
+			}
+			return;
+		}
+		#endif
+		fill( sums, sums+8, Real(0) );
+		for (int x=0; x<n; ++x) {
+			const SReal *dom= domPixels[domBlock.x0+x]+domBlock.y0;
+			for (int r=0; r<8; ++r)
+				sums[r]+= columnProduct( dom, layouts + rotationColumns[r].layout*n2
+					+ ( rotationColumns[r].mirrored ? n-1-x : x )*n, n );
+		}
+	}
+}
+
 /** Structure constructed for a range to try domains */
 struct MStdEncoder::EncodingInfo {
-	/** The type for exact-comparing methods */
-	typedef bool (EncodingInfo::*ExactCompareProc)( Prediction prediction );
+	typedef IStdEncPredictor::Predictions Predictions;
+	/** The type for exact-comparing methods (for \p count \p predictions, see ::exactCompare) */
+	typedef bool (EncodingInfo::*ExactCompareProc)
+		( const Prediction *predictions, int count, float sufficientSE );
 
 private:
 	static const ExactCompareProc exactCompareArray[];	///< Possible comparing methods
 
 	ExactCompareProc selectedProc;						///< Selected comparing method
+
+	std::vector<Real> rangeLayouts;	///< the range in layouts for ::rotationProducts (lazy)
+	Real lastRotationSums[8];		///< the last result of ::getRotationSums
+
+	/** The data of all predictions in a chunk (reused for all chunks of the range) */
+	struct ChunkData {
+		std::vector<const Pool*> pools;	///< the pools of the domains
+		std::vector<Block> domBlocks;	///< the domain blocks (adjusted for irregular ranges)
+		std::vector<Real> dSums			///  the sums of domains' pixels
+		, d2Sums						///  the sums of squares of domains' pixels
+		, denoms						///  1/(pixCount*d2Sum-sqr(dSum)), zero for rejected domains
+		, rdSums;						///< the sums of products of range and domain pixels
+		std::vector<float> optSEs;		///< the errors (infinite for rejected domains)
+	} chunk;
 public:
 	StableInfo stable;	///< Information only depending on the range (and not domain) block
 	BestInfo best;		///< Information about the best (at the moment) mapping found
 	float targetSE;		///< The target SE (square error) for the range
+	const DomainStats *domainStats;	///< The statistics of the domains on the range's level
+	bool earlyTermination;	///< Whether to stop comparing hopeless domains (::stripedProduct)
 
 public:
-	/** Only nulls ::selectedProc */
+	/** Only nulls ::selectedProc and ::domainStats */
 	EncodingInfo()
-	: selectedProc(0) {}
+	: selectedProc(0), domainStats(0) {}
 
 	/** Initializes a RangeInfo object from \p this */
 	RangeInfo* initRangeInfo(RangeInfo *ri) const {
@@ -231,15 +511,115 @@ public:
 		];
 	}
 
-	/** Uses the selected comparing method */
-	bool exactCompare(Prediction prediction)
-		{ return (this->* selectedProc)(prediction); }
+	/** Uses the selected comparing method on a chunk of \p predictions (in their order),
+	 *	returns true if the best error has got below \p sufficientSE (skipping the rest).
+	 *	Big chunks are processed in smaller batches not to waste work after the stop. */
+	bool exactCompare( const Predictions &predictions, float sufficientSE ) {
+		int count= predictions.size();
+		for (int begin=0; begin<count; ) {
+		//	find the end of the batch, don't split runs of predictions of one domain
+			int end= min( begin+MaxComparedBatch, count );
+			while ( end<count && predictions[end].domainID==predictions[end-1].domainID )
+				++end;
+			if ( (this->* selectedProc)( &predictions[begin], end-begin, sufficientSE ) )
+				return true;
+			begin= end;
+		}
+		return false;
+	}
 
 private:
+	/** Computes the sums of products of the range with domain \p domainID in all the
+	 *	rotations at once if it pays off for \p predCount predictions of the domain,
+	 *	returns zero otherwise. The result is only valid until the next call. */
+	const Real* getRotationSums( int domainID, int predCount ) {
+		if ( !stable.allowRotations || !stable.isRegular || predCount<MinBatchedPredictions )
+			return 0;
+		if ( rangeLayouts.empty() )
+			makeRotationLayouts( stable.rangePixels->pixels, *stable.rangeBlock, rangeLayouts );
+		rotationProducts( &rangeLayouts[0], domainStats->pools[domainID]->pixels
+		, domainStats->blocks[domainID], lastRotationSums );
+		return lastRotationSums;
+	}
+
+	/** Computes the error of a mapping from the absolute value of
+	 *	pixCount*rdSum-rSum*dSum and from 1/(pixCount*d2Sum-sqr(dSum)) (\p denom),
+	 *	the error decreases with \p absNRDs_RsDs */
+	template<bool quantErrors,bool bigScalePenalty>
+	float mappingError( Real absNRDs_RsDs, Real denom, Real contrFactor ) const {
+		float optSE DEBUG_ONLY(= numeric_limits<Real>::quiet_NaN() );
+		if (quantErrors) {
+			optSE= stable.qrAvg * ( stable.pixCount*stable.qrAvg - ldexp(stable.rSum,1) )
+				+ stable.r2Sum + stable.qrDev
+					* ( stable.pixCount*stable.qrDev - ldexp( absNRDs_RsDs*sqrt(denom), 1 ) );
+		} else { // !quantErrors
+		//	assuming different linear coeffitient
+			Real inner= stable.rnDev2 - stable.rnDev*absNRDs_RsDs*sqrt(denom);
+			optSE= ldexp( inner, 1 ) / stable.pixCount;
+		}
+	//	add big-scaling penalty if needed
+		if (bigScalePenalty)
+			optSE+= stable.rnDev2*denom * targetSE * contrFactor * stable.bigScaleCoeff;
+		return optSE;
+	}
+
+	/** Computes the sum of products for the regular range and the domain number \p i
+	 *	of ::chunk by stripes of domain columns. After every stripe the remaining part
+	 *	(centered by the averages) is bounded by Cauchy-Schwarz inequality and if the mapping
+	 *	can't get an error below \p maxSE, it returns false without finishing the sum. */
+	template<bool quantErrors,bool allowInversion,bool bigScalePenalty>
+	bool stripedProduct( int i, int rotation, float maxSE ) {
+		const Block &domBlock= chunk.domBlocks[i];
+		const Pool &pool= *chunk.pools[i];
+		int n= domBlock.width(), stripe= max(1,n/StripeCount);
+		if ( rangeLayouts.empty() )
+			makeRotationLayouts( stable.rangePixels->pixels, *stable.rangeBlock, rangeLayouts );
+		int layoutIndex= rotationColumns[rotation].layout;
+		const Real *layout= &rangeLayouts[ layoutIndex*n*n ]
+		, *colSums= &rangeLayouts[ 4*n*n + layoutIndex*n ], *colSums2= colSums+4*n;
+		bool mirrored= rotationColumns[rotation].mirrored;
+		Real rAvg= stable.rSum/stable.pixCount, dAvg= chunk.dSums[i]/stable.pixCount;
+
+		Real rdSum= 0, rDone= 0, r2Done= 0;
+		for (int x=0; ; ) {
+			for (int stripeEnd=min(x+stripe,n); x<stripeEnd; ++x) {
+				int col= mirrored ? n-1-x : x;
+				rdSum+= columnProduct( pool.pixels[domBlock.x0+x]+domBlock.y0, layout+col*n, n );
+				rDone+= colSums[col];
+				r2Done+= colSums2[col];
+			}
+			if (x==n)
+				break;
+		//	get the centered sum of products of the done pixels
+			Real dDone, d2Done;
+			pool.getSums( Block(domBlock.x0,domBlock.y0,domBlock.x0+x,domBlock.yend) )
+				.unpack(dDone,d2Done);
+			Real doneCount= x*n, restCount= stable.pixCount-doneCount;
+			Real known= stable.pixCount
+				* ( rdSum - dAvg*rDone - rAvg*dDone + doneCount*rAvg*dAvg );
+		//	bound the centered sum of products of the remaining pixels
+		//	(with a tiny reserve for rounding errors)
+			Real rRestDev2= stable.r2Sum-r2Done - 2*rAvg*(stable.rSum-rDone) + restCount*sqr(rAvg)
+			, dRestDev2= chunk.d2Sums[i]-d2Done - 2*dAvg*(chunk.dSums[i]-dDone)
+				+ restCount*sqr(dAvg);
+			Real restMax= stable.pixCount * ( sqrt( max<Real>(0,rRestDev2)*max<Real>(0,dRestDev2) )
+				+ Real(1e-9)*abs(rdSum) );
+			if ( !allowInversion && known+restMax<0 )
+				return false;
+			Real maxAbs= allowInversion
+				? max( abs(known-restMax), abs(known+restMax) ) : known+restMax;
+			if ( mappingError<quantErrors,bigScalePenalty>
+				( maxAbs, chunk.denoms[i], pool.contrFactor ) > maxSE )
+				return false;
+		}
+		chunk.rdSums[i]= rdSum;
+		return true;
+	}
+
 	/** Template for all the comparing methods */
 	template < bool quantErrors, bool allowInversion, bool isRegular
 	, bool restrictMaxLinCoeff, bool bigScalePenalty >
-	bool exactCompareProc( Prediction prediction );
+	bool exactCompareProc( const Prediction *predictions, int count, float sufficientSE );
 }; // EncodingInfo struct
 
 #define ALTERNATE_0(name,params...) name<params>
@@ -259,77 +639,105 @@ const MStdEncoder::EncodingInfo::ExactCompareProc MStdEncoder::EncodingInfo::exa
 
 template< bool quantErrors, bool allowInversion, bool isRegular
 , bool restrictMaxLinCoeff, bool bigScalePenalty >
-bool MStdEncoder::EncodingInfo::exactCompareProc( Prediction prediction ) {
+bool MStdEncoder::EncodingInfo::exactCompareProc
+( const Prediction *predictions, int count, float sufficientSE ) {
 	using namespace MatrixWalkers;
-//	find out which domain was predicted (pixel matrix and position within it)
-	Block domBlock;
-	const Pool &pool= getDomainData( *stable.rangeBlock, *stable.pools, *stable.poolInfos
-	, prediction.domainID, 0/*zoom*/, domBlock );
-//	compute domain sums
-	if (!isRegular)
-		domBlock= adjustDomainForIncompleteRange
-			( *stable.rangeBlock, prediction.rotation, domBlock );
-	Real dSum, d2Sum;
-	pool.getSums(domBlock).unpack(dSum,d2Sum);
-//	compute the denominator common to most formulas
-	Real test= stable.pixCount*d2Sum - sqr(dSum);
-	if (test<=0) // skip too flat domains
-		return false;
-	Real denom= 1/test;
-
-//	compute the sum of products of pixels
-	Real rdSum= walkOperateCheckRotate
-	( Checked<const SReal>(stable.rangePixels->pixels, *stable.rangeBlock), RDSummer<Real,SReal>()
-	, pool.pixels, domBlock, prediction.rotation ) .result();
-
-	Real nRDs_RsDs= stable.pixCount*rdSum - stable.rSum*dSum;
-//	check for negative linear coefficients (if needed)
-	if (!allowInversion)
-		if (nRDs_RsDs<0)
-			return false;
-//	compute the square of linear coefficient if needed (for restricting or penalty)
-	Real linCoeff2 DEBUG_ONLY(= numeric_limits<Real>::quiet_NaN() );
-	if ( restrictMaxLinCoeff || bigScalePenalty )
-		linCoeff2= stable.rnDev2 * denom;
-	if (restrictMaxLinCoeff)
-		if ( linCoeff2 > stable.maxLinCoeff2 )
-			return false;
-
-	float optSE DEBUG_ONLY(= numeric_limits<Real>::quiet_NaN() );
-
-	if (quantErrors) {
-		optSE= stable.qrAvg * ( stable.pixCount*stable.qrAvg - ldexp(stable.rSum,1) )
-			+ stable.r2Sum + stable.qrDev
-				* ( stable.pixCount*stable.qrDev - ldexp( abs(nRDs_RsDs)*sqrt(denom), 1 ) );
-	} else { // !quantErrors
-	//	assuming different linear coeffitient
-		Real inner= stable.rnDev2 - stable.rnDev*abs(nRDs_RsDs)*sqrt(denom);
-		optSE= ldexp( inner, 1 ) / stable.pixCount;
-	}
-
-//	add big-scaling penalty if needed
-	if (bigScalePenalty)
-		optSE+= linCoeff2 * targetSE * pool.contrFactor * stable.bigScaleCoeff;
-
-//	test if the error is the best so far
-	if ( optSE < best.error ) {
-		best.prediction()= prediction;
-		best.error= optSE;
-		best.inverted= nRDs_RsDs<0;
+	chunk.pools.resize(count);
+	chunk.domBlocks.resize(count);
+	chunk.dSums.resize(count);
+	chunk.d2Sums.resize(count);
+	chunk.denoms.resize(count);
+	chunk.rdSums.resize(count);
+	chunk.optSEs.resize(count);
+
+//	find out which domains were predicted and get their sums and the denominator common
+//	to most formulas (precomputed for regular ranges), zero denominators mark rejected domains
+	for (int i=0; i<count; ++i) {
+		const Prediction &prediction= predictions[i];
+		if (isRegular) {
+			int id= prediction.domainID;
+			chunk.pools[i]= domainStats->pools[id];
+			chunk.domBlocks[i]= domainStats->blocks[id];
+			chunk.dSums[i]= domainStats->sums[id];
+			chunk.d2Sums[i]= domainStats->sums2[id];
+			chunk.denoms[i]= domainStats->denoms[id];
+		} else {
+			chunk.pools[i]= &getDomainData( *stable.rangeBlock, *stable.pools, *stable.poolInfos
+			, prediction.domainID, 0/*zoom*/, chunk.domBlocks[i] );
+			chunk.domBlocks[i]= adjustDomainForIncompleteRange
+				( *stable.rangeBlock, prediction.rotation, chunk.domBlocks[i] );
+			chunk.pools[i]->getSums(chunk.domBlocks[i]).unpack(chunk.dSums[i],chunk.d2Sums[i]);
+			Real test= stable.pixCount*chunk.d2Sums[i] - sqr(chunk.dSums[i]);
+			chunk.denoms[i]= test>0 ? 1/test : 0; // skip too flat domains
+		}
+	//	restrict the linear coefficient if needed
+		if ( restrictMaxLinCoeff && stable.rnDev2*chunk.denoms[i] > stable.maxLinCoeff2 )
+			chunk.denoms[i]= 0;
+	}
+
+//	compute the sums of products of pixels, for runs of predictions of one domain
+//	in different rotations the sums may be computed at once, for single predictions
+//	the computation may be terminated early (the best error can only decrease)
+	bool striped= isRegular && earlyTermination
+		&& stable.rangeBlock->width() >= MinStripedSide;
+	float maxSE= best.error;
+	for (int i=0; i<count; ) {
+		int runEnd= i+1;
+		while ( runEnd<count && predictions[runEnd].domainID==predictions[i].domainID )
+			++runEnd;
+		const Real *rotationSums= isRegular
+			? getRotationSums( predictions[i].domainID, runEnd-i ) : 0;
+		for (; i<runEnd; ++i) {
+			if (!chunk.denoms[i])
+				continue;
+			if (rotationSums)
+				chunk.rdSums[i]= rotationSums[ int(predictions[i].rotation) ];
+			else if (striped) {
+				if ( !stripedProduct<quantErrors,allowInversion,bigScalePenalty>
+						( i, predictions[i].rotation, maxSE ) )
+					chunk.denoms[i]= 0;
+			} else
+				chunk.rdSums[i]= walkOperateCheckRotate( Checked<const SReal>
+					(stable.rangePixels->pixels, *stable.rangeBlock), RDSummer<Real,SReal>()
+					, chunk.pools[i]->pixels, chunk.domBlocks[i], predictions[i].rotation )
+					.result();
+		}
+	}
+
+//	compute the errors of all the mappings
+	for (int i=0; i<count; ++i) {
+		Real denom= chunk.denoms[i];
+		Real nRDs_RsDs= stable.pixCount*chunk.rdSums[i] - stable.rSum*chunk.dSums[i];
+	//	rejected domains and negative linear coefficients (if not allowed) get infinite errors
+		chunk.optSEs[i]= !denom || (!allowInversion && nRDs_RsDs<0)
+			? numeric_limits<float>::infinity()
+			: mappingError<quantErrors,bigScalePenalty>
+				( abs(nRDs_RsDs), denom, chunk.pools[i]->contrFactor );
+	}
+
+//	pick the best mapping (in the order of predictions), stop if it's good enough
+	for (int i=0; i<count; ++i) {
+		if ( !(chunk.optSEs[i] < best.error) )
+			continue;
+		best.prediction()= predictions[i];
+		best.error= chunk.optSEs[i];
+		best.inverted= stable.pixCount*chunk.rdSums[i] - stable.rSum*chunk.dSums[i] < 0;
 
 		#ifndef NDEBUG
-		best.rdSum= rdSum;
-		best.dSum= dSum;
-		best.d2Sum= d2Sum;
+		best.rdSum= chunk.rdSums[i];
+		best.dSum= chunk.dSums[i];
+		best.d2Sum= chunk.d2Sums[i];
 		#endif
-		
-		return true;
-	} else
-		return false;
+
+		if ( best.error<=sufficientSE )
+			return true;
+	}
+	return false;
 } // EncodingInfo::exactCompareProc method
 
 
-float MStdEncoder::findBestSE(const RangeNode &range,bool allowHigherSE) {
+float MStdEncoder::findBestSE
+(const RangeNode &range,bool allowHigherSE,const RangeList *seedRanges) {
 	ASSERT( planeBlock && !stdRangeSEs.empty() && !range.encoderData );
 	const IColorTransformer::PlaneSettings *plSet= planeBlock->settings;
 
@@ -342,11 +750,9 @@ float MStdEncoder::findBestSE(const RangeNode &range,bool allowHigherSE) {
 
 	ASSERT( range.level < (int)levelPoolInfos.size() );
 	info.stable.poolInfos=		&levelPoolInfos[range.level];
-//	check the level has been initialized
-	if ( info.stable.poolInfos->empty() ) {
-		buildPoolInfos4aLevel(range.level);
-		ASSERT( !info.stable.poolInfos->empty() );
-	}
+	info.domainStats=			&levelDomainStats[range.level];
+//	all the levels have been initialized in ::initialize
+	ASSERT( !info.stable.poolInfos->empty() );
 
 	info.stable.allowRotations=	settingsInt(AllowedRotations);
 	info.stable.quantError=		settingsInt(AllowedQuantError);
@@ -357,6 +763,7 @@ float MStdEncoder::findBestSE(const RangeNode &range,bool allowHigherSE) {
 		info.stable.maxLinCoeff2=	coeff==MaxLinCoeff_none ? -1 : sqr(coeff);
 	}
 	info.stable.bigScaleCoeff=	settingsFloat(BigScaleCoeff);
+	info.earlyTermination=		settingsInt(EarlyTermination);
 
 	planeBlock->getSums(range).unpack( info.stable.rSum, info.stable.r2Sum );
 	info.stable.pixCount=	range.size();
@@ -400,13 +807,16 @@ float MStdEncoder::findBestSE(const RangeNode &range,bool allowHigherSE) {
 		Predictions predicts;
 	
 		float sufficientSE= info.targetSE*settingsFloat(SufficientSEq);
+	//	try the domains of the related ranges first (to lower the best error early)
+		if ( seedRanges && settingsInt(RelatedSeeding) ) {
+			getRelatedSeeds(range,*seedRanges,predicts);
+			if ( !predicts.empty() && info.exactCompare(predicts,sufficientSE) )
+				goto returning;
+		}
 	//	get and process prediction chunks until an empty one is returned
 		while ( !predictor->getChunk(info.best.error,predicts).empty() )
-			for (Predictions::iterator it=predicts.begin(); it!=predicts.end(); ++it) {
-				bool betterSE= info.exactCompare(*it);
-				if ( betterSE && info.best.error<=sufficientSE )
-					goto returning;
-			}
+			if ( info.exactCompare(predicts,sufficientSE) )
+				goto returning;
 	}
 		
 	returning:
@@ -419,7 +829,12 @@ float MStdEncoder::findBestSE(const RangeNode &range,bool allowHigherSE) {
 			: variance*info.stable.pixCount;
 	}
 //	store the important info and return the error
-	range.encoderData= info.initRangeInfo( /*rangeInfoAlloc.make()*/ new RangeInfo );
+	RangeInfo *rangeInfo;
+	{
+		QMutexLocker locker(&rangeInfoMutex);
+		rangeInfo= rangeInfoAlloc.make();
+	}
+	range.encoderData= info.initRangeInfo(rangeInfo);
 	return info.best.error;
 } // ::findBestSE method
 
@@ -450,6 +865,49 @@ void MStdEncoder::buildPoolInfos4aLevel(int level) {
 		poolInfos[i+1].indexBegin= domCount;
 	}
 	poolInfos[poolCount].density= -1;
+
+//	compute the positions of all the domains on the level (like ::getDomainData)
+	DomainStats &stats= levelDomainStats[level];
+	stats.pools.resize(domCount);
+	stats.blocks.resize(domCount);
+	int zoomFactor= powers[zoom], side= powers[level];
+	for (int i=0; i<poolCount; ++i) {
+		int dens= poolInfos[i].density;
+		if (!dens)
+			continue;
+		int domsInCol= getCountForDensity( pools[i].height/zoomFactor, dens, domainSizeNZ );
+		for (int id=poolInfos[i].indexBegin; id<poolInfos[i+1].indexBegin; ++id) {
+			int indexInPool= id-poolInfos[i].indexBegin;
+			Block &block= stats.blocks[id];
+			block.x0= (indexInPool/domsInCol)*dens*zoomFactor;
+			block.y0= (indexInPool%domsInCol)*dens*zoomFactor;
+			block.xend= block.x0+side;
+			block.yend= block.y0+side;
+			stats.pools[id]= &pools[i];
+		}
+	}
+}
+
+void MStdEncoder::fillDomainStats(int level,bool onlyUsed) {
+	DomainStats &stats= levelDomainStats[level];
+	int domCount= stats.size();
+	stats.sums.resize(domCount);
+	stats.sums2.resize(domCount);
+	stats.denoms.resize(domCount);
+	Real pixCount= sqr<Real>(powers[level]);
+	int count= onlyUsed ? (int)stats.used.size() : domCount;
+	for (int i=0; i<count; ++i) {
+		int id= onlyUsed ? stats.used[i] : i;
+		const Pool &pool= *stats.pools[id];
+		if ( onlyUsed && !schedule.poolRegions.empty() )
+			makeRegionSumsValid( pool
+			, schedule.poolRegions[ &pool - &planeBlock->domains->getPools().front() ] );
+		else
+			makeSumsValid(pool);
+		pool.getSums(stats.blocks[id]).unpack( stats.sums[id], stats.sums2[id] );
+		Real test= pixCount*stats.sums2[id] - sqr(stats.sums[id]);
+		stats.denoms[id]= test>0 ? 1/test : 0;
+	}
 }
 
 void MStdEncoder::writeSettings(ostream &file) {
@@ -592,7 +1050,7 @@ void MStdEncoder::readData(istream &file,int phase) {
 			for (RLcIterator it=ranges.begin(); it!=ranges.end(); ++it) {
 				ASSERT( *it && !(*it)->encoderData );
 				STREAM_POS(file);
-				RangeInfo *info= new RangeInfo;//rangeInfoAlloc.make();
+				RangeInfo *info= rangeInfoAlloc.make();
 				(*it)->encoderData= info;
 				info->qrAvg= quant.dequant(averages[it-ranges.begin()]);
 				DEBUG_ONLY( info->bestSE= -1; ) // SE not needed for decoding,saving,...
@@ -675,13 +1133,16 @@ void MStdEncoder::readData(istream &file,int phase) {
 		default:
 			ASSERT(false);
 	}
+//	any phase can be the last one read, the last phase builds the schedule
+//	in ::initRangeInfoAccelerators, the schedule of the earlier ones has no domains
+	if ( phase < phaseCount()-1 )
+		buildDecodeSchedule();
 } // ::readData method
 
-void MStdEncoder::decodeAct( DecodeAct action, int count ) {
+int MStdEncoder::decodeAct( DecodeAct action, int count ) {
 //	do some checks
 	ASSERT( planeBlock && planeBlock->ranges && planeBlock->encoder==this );
-	const RangeList &ranges= planeBlock->ranges->getRangeList();
-	ASSERT( !ranges.empty() );
+	ASSERT( !planeBlock->ranges->getRangeList().empty() );
 
 	switch (action) {
 	default:
@@ -691,41 +1152,222 @@ void MStdEncoder::decodeAct( DecodeAct action, int count ) {
 		planeBlock->pixels.fillSubMatrix
 			( Block(0,0,planeBlock->width,planeBlock->height), 0.5f );
 		planeBlock->summers_invalidate();
-		break;
+		poolsFilled= false;
+		return 0;
 	case Iterate:
 		ASSERT(count>0);
-		do {
-		//	prepare the domains, iterate each range block
-			planeBlock->domains->fillPixelsInPools(*planeBlock);
-			for (RangeList::const_iterator it=ranges.begin(); it!=ranges.end(); ++it) {
-				const RangeInfo &info= *RangeInfo::get(*it);
-				if ( info.domainID < 0 ) { // no domain - constant color
-					planeBlock->pixels.fillSubMatrix( **it, info.qrAvg );
-					continue;
-				}
-			//	get domain sums and the pixel count
+		for (int i=0; i<count; ++i)
+			decodeIteration(false);
+		return count;
+	case Converge: {
+		ASSERT(count>0);
+	//	the maximal sum of squared changes (the threshold is RMS in 0-255 levels)
+		Real maxDelta2= sqr( settingsFloat(DecodeConvergence)/255 )
+			* planeBlock->width * planeBlock->height;
+		int done= 0;
+		bool converged;
+		do
+			converged= decodeIteration(true) <= maxDelta2;
+		while ( ++done<count && !converged );
+		return done;
+		}
+	} // switch (action)
+} // ::decodeAct method
+
+namespace NOSPACE {
+	/** Fills a \p block of \p pixels with a \p value like MatrixSlice::fillSubMatrix,
+	 *	returns the sum of squared changes of the pixels */
+	Real fillSubMatrixDelta( SMatrix pixels, const Block &block, SReal value ) {
+		Real result= 0;
+		SReal *colEnd= pixels.start+block.y0+pixels.colSkip*block.xend;
+		for (SReal *col= pixels.start+block.y0+pixels.colSkip*block.x0; col!=colEnd
+		; col+= pixels.colSkip)
+			for (SReal *it= col; it!=col+block.height(); ++it) {
+				result+= sqr(*it-value);
+				*it= value;
+			}
+		return result;
+	}
+	/** Computes the sums of values and squares of a \p block of \p pixels directly
+	 *	(without using summers) */
+	DoubleNum<Real> getSumsDirectly( CSMatrix pixels, const Block &block ) {
+		DoubleNum<Real> result(0);
+		const SReal *colEnd= pixels.start+block.y0+pixels.colSkip*block.xend;
+		for (const SReal *col= pixels.start+block.y0+pixels.colSkip*block.x0; col!=colEnd
+		; col+= pixels.colSkip)
+			for (const SReal *it= col; it!=col+block.height(); ++it) {
+				result.value+= *it;
+				result.square+= sqr<Real>(*it);
+			}
+		return result;
+	}
+}
+Real MStdEncoder::decodeIteration(bool measure) {
+//	the schedule is built by ::readData or ::finishEncoding
+	ASSERT( schedule.size() == (int)planeBlock->ranges->getRangeList().size() );
+	bool inPlace= settingsInt(DecodeInPlace);
+	Real delta2= 0;
+//	prepare the domains and compute all the coefficients at once (the summers would be
+//	invalid when in place, then the coefficients are computed just before every use;
+//	the in-place iterations keep the pools up to date, so they're only filled once)
+	if ( !inPlace || !poolsFilled )
+		planeBlock->domains->fillPixelsInPools(*planeBlock);
+	poolsFilled= inPlace;
+	if (!inPlace)
+		computeScheduleCoeffs();
+//	iterate each range block (in Hilbert order, when in place,
+//	the changes of a range are immediately propagated to the domains)
+	for (int i=0, count=schedule.size(); i<count; ++i) {
+		const Block &rangeBlock= schedule.rangeBlocks[i];
+		const Pool *pool= schedule.pools[i];
+		if (inPlace) {
+			Real linCoeff= 0, constCoeff= schedule.qrAvgs[i];
+			if (pool) {
 				Real dSum, d2Sum;
-				info.decAccel.pool->summers_makeValid();
-				info.decAccel.pool->getSums(info.decAccel.domBlock).unpack(dSum,d2Sum);
-				Real pixCount= (*it)->size();
-			//	find out the coefficients and handle constant blocks
-				Real linCoeff= (info.inverted ? -pixCount : pixCount)
-					* sqrt( info.qrDev2 / ( pixCount*d2Sum - sqr(dSum) ) );
-				if ( !isnormal(linCoeff) || !linCoeff ) {
-					planeBlock->pixels.fillSubMatrix( **it, info.qrAvg );
-					continue;
-				}
-				Real constCoeff= info.qrAvg - linCoeff*dSum/pixCount;
-			//	map the nonconstant blocks
-				using namespace MatrixWalkers;
+				getSumsDirectly( pool->pixels, schedule.domBlocks[i] ).unpack(dSum,d2Sum);
+				Real pixCount= rangeBlock.size();
+				linCoeff= schedule.linFactors[i] / sqrt( pixCount*d2Sum - sqr(dSum) );
+				if ( isnormal(linCoeff) )
+					constCoeff-= linCoeff*dSum/pixCount;
+				else
+					linCoeff= 0;
+			}
+			schedule.linCoeffs[i]= linCoeff;
+			schedule.constCoeffs[i]= constCoeff;
+		}
+		Real linCoeff= schedule.linCoeffs[i], constCoeff= schedule.constCoeffs[i];
+	//	handle blocks with no domain or with constant domain - use constant color
+		if (!linCoeff) {
+			if (measure)
+				delta2+= fillSubMatrixDelta( planeBlock->pixels, rangeBlock, constCoeff );
+			else
+				planeBlock->pixels.fillSubMatrix( rangeBlock, constCoeff );
+		} else {
+		//	map the nonconstant blocks
+			using namespace MatrixWalkers;
+			if (measure) {
+				MulAddCopyCheckedDelta<Real> oper( linCoeff, constCoeff, 0, 1 );
+				delta2+= walkOperateCheckRotate( Checked<SReal>(planeBlock->pixels, rangeBlock)
+				, oper, pool->pixels, schedule.domBlocks[i], schedule.rotations[i] ).delta2;
+			} else {
 				MulAddCopyChecked<Real> oper( linCoeff, constCoeff, 0, 1 );
-				walkOperateCheckRotate( Checked<SReal>(planeBlock->pixels, **it), oper
-				, info.decAccel.pool->pixels, info.decAccel.domBlock, info.rotation );
+				walkOperateCheckRotate( Checked<SReal>(planeBlock->pixels, rangeBlock)
+				, oper, pool->pixels, schedule.domBlocks[i], schedule.rotations[i] );
 			}
-		} while (--count);
-		break;
-	} // switch (action)
-} // ::decodeAct method
+		}
+		if (inPlace)
+			planeBlock->domains->refreshPixelsInPools( *planeBlock, rangeBlock );
+	}
+	return delta2;
+}
+
+void MStdEncoder::computeScheduleCoeffs() {
+//	compute the sums of the used domains (only once for domains shared by more ranges)
+	for (int level=0; level<(int)levelDomainStats.size(); ++level)
+		if ( !levelDomainStats[level].used.empty() )
+			fillDomainStats(level,true);
+
+	for (int i=0, count=schedule.size(); i<count; ++i) {
+		Real linCoeff= 0, constCoeff= schedule.qrAvgs[i];
+		if (schedule.pools[i]) {
+		//	get domain sums and the pixel count (the precomputed sums cover whole domains,
+		//	so the cropped domains of incomplete ranges have to be summed separately)
+			const Block &rangeBlock= schedule.rangeBlocks[i];
+			int side= powers[ schedule.levels[i] ];
+			Real dSum, d2Sum;
+			if ( rangeBlock.width()==side && rangeBlock.height()==side ) { // regular
+				const DomainStats &stats= levelDomainStats[ schedule.levels[i] ];
+				int id= schedule.domainIDs[i];
+				dSum= stats.sums[id];
+				d2Sum= stats.sums2[id];
+			} else
+				schedule.pools[i]->getSums(schedule.domBlocks[i]).unpack(dSum,d2Sum);
+			Real pixCount= rangeBlock.size();
+		//	find out the coefficients, the linear one is zero for constant blocks
+			linCoeff= schedule.linFactors[i] / sqrt( pixCount*d2Sum - sqr(dSum) );
+			if ( isnormal(linCoeff) )
+				constCoeff-= linCoeff*dSum/pixCount;
+			else
+				linCoeff= 0;
+		}
+		schedule.linCoeffs[i]= linCoeff;
+		schedule.constCoeffs[i]= constCoeff;
+	}
+}
+
+void MStdEncoder::buildDecodeSchedule() {
+	const RangeList &ranges= planeBlock->ranges->getRangeList();
+	int count= ranges.size();
+	schedule.rangeBlocks.resize(count);
+	schedule.domBlocks.resize(count);
+	schedule.pools.resize(count);
+	schedule.rotations.resize(count);
+	schedule.levels.resize(count);
+	schedule.domainIDs.resize(count);
+	schedule.qrAvgs.resize(count);
+	schedule.linFactors.resize(count);
+	schedule.linCoeffs.resize(count);
+	schedule.constCoeffs.resize(count);
+	poolsFilled= false; // the needed pool regions may change
+	for (int level=0; level<(int)levelDomainStats.size(); ++level)
+		levelDomainStats[level].used.clear();
+//	copy the data of all the ranges, fix the variance-dependent part of the coefficient
+	for (int i=0; i<count; ++i) {
+		const RangeNode &range= *ranges[i];
+		const RangeInfo &info= *RangeInfo::get(&range);
+		schedule.rangeBlocks[i]= range;
+		schedule.qrAvgs[i]= info.qrAvg;
+		if ( info.domainID >= 0 ) {
+			schedule.domBlocks[i]= info.decAccel.domBlock;
+			schedule.pools[i]= info.decAccel.pool;
+			schedule.rotations[i]= info.rotation;
+			schedule.levels[i]= range.level;
+			schedule.domainIDs[i]= info.domainID;
+			levelDomainStats[range.level].used.push_back(info.domainID);
+			Real pixCount= range.size();
+			schedule.linFactors[i]= (info.inverted ? -pixCount : pixCount) * sqrt(info.qrDev2);
+		} else {
+			schedule.pools[i]= 0;
+			schedule.rotations[i]= 0;
+			schedule.levels[i]= schedule.domainIDs[i]= -1;
+			schedule.linFactors[i]= 0;
+		}
+	}
+//	make the lists of used domains unique
+	for (int level=0; level<(int)levelDomainStats.size(); ++level) {
+		vector<int> &used= levelDomainStats[level].used;
+		sort( used.begin(), used.end() );
+		used.erase( unique( used.begin(), used.end() ), used.end() );
+	}
+	buildPoolRegions();
+}
+
+void MStdEncoder::buildPoolRegions() {
+	const ISquareDomains::PoolList &pools= planeBlock->domains->getPools();
+	vector<Block> &regions= schedule.poolRegions;
+	regions.assign( pools.size(), Block(0,0,0,0) );
+	for (int level=0; level<(int)levelDomainStats.size(); ++level) {
+		const DomainStats &stats= levelDomainStats[level];
+		for (vector<int>::const_iterator it=stats.used.begin(); it!=stats.used.end(); ++it) {
+			if ( *it >= stats.size() ) { // the positions aren't known -> fill whole pools
+				regions.clear();
+				break;
+			}
+			const Block &block= stats.blocks[*it];
+			Block &region= regions[ stats.pools[*it] - &pools.front() ];
+			if ( region.x0 < region.xend ) {
+				region.x0= min(region.x0,block.x0);
+				region.y0= min(region.y0,block.y0);
+				region.xend= max(region.xend,block.xend);
+				region.yend= max(region.yend,block.yend);
+			} else
+				region= block;
+		}
+		if ( regions.empty() )
+			break;
+	}
+	planeBlock->domains->setNeededRegions(regions);
+}
 
 void MStdEncoder::initRangeInfoAccelerators() {
 //	get references that are the same for all range blocks
@@ -750,4 +1392,5 @@ void MStdEncoder::initRangeInfoAccelerators() {
 			info.decAccel.domBlock= adjustDomainForIncompleteRange
 				( **it, info.rotation, info.decAccel.domBlock );
 	}
+	buildDecodeSchedule();
 }
@@ -3,6 +3,8 @@
 
 #include "../headers.h"
 
+#include <QMutex>
+
 /// \ingroup modules
 /** Standard square encoder - uses affine color transformation
  *	for one-domain to one-range mappings. Uses modified mappings with fixed target
@@ -14,8 +16,13 @@
  *	- whether to take quantization errors into account
  *	- how much to restrict the linear coefficients (its absolute values)
  *	- the part of max. error that suffices (interrupts searching for better)
+ *	- whether to stop comparing a domain when it can't be better than the best one
+ *	- whether to seed the search by the domains of related ranges
  *	- the fineness of average and deviation quantization (separate, in powers of two)
  *	- codec modules for quantized averages and deviations (IIntCodec) 
+ *	- the pixel change small enough to stop converging decoding (not stored in files)
+ *	- whether to decode in place - the domains are updated right after a range changes
+ *	(not stored in files)
  *	When encoding, given a range block the module succesively tries domains returned 
  *	by the predictor, computes exact error and keeps track of the best-fitting domain
  *	seen (yet). */
@@ -77,13 +84,34 @@ public:
 		desc:	"The module that will code and decode standard\n"
 				"deviations of color values of range blocks",
 		type:	settingModule<IIntCodec>()
+	}, {
+		label:	"Decoding convergence threshold",
+		desc:	"Converging decoding stops when the root mean square change\n"
+				"of pixel values (in 0-255 levels) is below this value",
+		type:	settingFloat( 0, 0.5, 8 )
+	}, {
+		label:	"In-place decoding",
+		desc:	"Update the domains right after every change of a range block\n"
+				"(usually needs fewer iterations to converge)",
+		type:	settingCombo("no\nyes",0)
+	}, {
+		label:	"Early termination of comparisons",
+		desc:	"Stop comparing a domain block when an estimate shows\n"
+				"it can't be better than the best one found",
+		type:	settingCombo("no\nyes",1)
+	}, {
+		label:	"Seeding from related ranges",
+		desc:	"Before using the predictor, try the domain blocks derived\n"
+				"from those of already encoded neighbour or son range blocks",
+		type:	settingCombo("no\nyes",1)
 	} )
 
 protected:
 	/** Indices for settings */
 	enum Settings { ModulePredictor, AllowedRotations, AllowedInversion, BigScaleCoeff
 	, AllowedQuantError, MaxLinCoeff, SufficientSEq, QuantStepLog_avg, QuantStepLog_dev
-	, ModuleCodecAvg, ModuleCodecDev };
+	, ModuleCodecAvg, ModuleCodecDev, DecodeConvergence, DecodeInPlace, EarlyTermination
+	, RelatedSeeding };
 //	Settings-retieval methods
 	float settingsFloat(Settings index)
 		{ return settings[index].val.f; }
@@ -136,22 +164,67 @@ protected:
 	PlaneBlock *planeBlock;			///< Pointer to the block to encode/decode
 	std::vector<float> stdRangeSEs;	///< Caches the result of IQuality2SE::regularRangeErrors
 	LevelPoolInfos levelPoolInfos;	///< see LevelPoolInfos, only initialized for used levels
+									///< (all levels when encoding)
+
+	/** Precomputed data of all domain blocks on a level (indexed by domain IDs),
+	 *	the positions are set in ::buildPoolInfos4aLevel and the sums in ::fillDomainStats */
+	struct DomainStats {
+		std::vector<const Pool*> pools;	///< the pools of the domains
+		std::vector<Block> blocks;		///< the domain blocks (in their pools)
+		std::vector<Real> sums			///  the sums of the domains' pixels
+		, sums2							///  the sums of squares of the domains' pixels
+		, denoms;						///< 1/(pixCount*sum2-sqr(sum)), zero for flat domains
+		std::vector<int> used;			///< IDs of the domains used by the ranges (for decoding)
+
+		/** Returns the number of domains on the level */
+		int size() const
+			{ return pools.size(); }
+	};
+	std::vector<DomainStats> levelDomainStats;	///< [level] -> DomainStats, built with ::levelPoolInfos
+
+	/** Flat decoding data of all range blocks (in the order of the range list),
+	 *	only the coefficients are recomputed in every iteration, see ::buildDecodeSchedule */
+	struct DecodeSchedule {
+		std::vector<Block> rangeBlocks	///  the range blocks
+		, domBlocks;					///< the domain blocks (in their pools)
+		std::vector<const Pool*> pools;	///< the pools of the domains (zero for constant blocks)
+		std::vector<char> rotations;	///< the rotations of the domains
+		std::vector<int> levels			///  the levels of the range blocks
+		, domainIDs;					///< the domain IDs (for ::levelDomainStats)
+		std::vector<Real> qrAvgs		///  quant-rounded target averages of the blocks
+		, linFactors					///  pixCount*sqrt(qrDev2) of the blocks (negative if inverted)
+		, linCoeffs						///  linear coefficients for the current iteration
+		, constCoeffs;					///< constant coefficients for the current iteration
+		std::vector<Block> poolRegions;	///< [poolID] -> the bounding box of the used domains
+										///< (empty blocks for unused pools)
+
+		/** Returns the number of scheduled range blocks */
+		int size() const
+			{ return rangeBlocks.size(); }
+	} schedule;						///< the decoding schedule
+	bool poolsFilled;				///< whether the pools reflect the current pixels
+									///< (in-place decoding keeps them up to date)
+
+	/** The allocator of RangeInfo for the range blocks (pointed by their encoderData),
+	 *	they are all freed at once with the module */
+	BulkAllocator<RangeInfo> rangeInfoAlloc;
+	QMutex rangeInfoMutex;			///< The lock for ::rangeInfoAlloc (parallel encoding)
 
 protected:
 //	Construction and destruction
 	/** Only initializes ::planeBlock to zero */
-	MStdEncoder(): planeBlock(0) {}
+	MStdEncoder(): planeBlock(0), poolsFilled(false) {}
 
 public:
 /**	\name ISquareEncoder interface
  *	@{ */
 	void initialize( IRoot::Mode mode, PlaneBlock &planeBlock_ );
-	float findBestSE(const RangeNode &range,bool allowHigherSE);
+	float findBestSE(const RangeNode &range,bool allowHigherSE,const RangeList *seedRanges);
 	void finishEncoding() {
 		initRangeInfoAccelerators();	// prepare for saving/decoding
 		modulePredictor()->cleanUp();	// free unneccesary memory of the predictor
 	}
-	void decodeAct( DecodeAct action, int count=1 );
+	int decodeAct( DecodeAct action, int count=1 );
 
 	void writeSettings(std::ostream &file);
 	void readSettings(std::istream &file);
@@ -162,10 +235,26 @@ public:
 	void readData(std::istream &file,int phase);
 ///	@}
 protected:
-	/** Builds ::levelPoolInfos[\p level], uses ::planeBlock->domains */
+	/** Builds ::levelPoolInfos[\p level] and the domain positions in ::levelDomainStats,
+	 *	uses ::planeBlock->domains */
 	void buildPoolInfos4aLevel(int level);
-	/** Initializes decoding accelerators (in RangeInfo) for all range blocks */
+	/** Fills the sums in ::levelDomainStats[\p level] from the summers of the pools,
+	 *	for all the domains or only for the DomainStats::used ones */
+	void fillDomainStats(int level,bool onlyUsed);
+	/** Initializes decoding accelerators (in RangeInfo) for all range blocks
+	 *	and builds the ::schedule */
 	void initRangeInfoAccelerators();
+	/** Builds ::schedule from the range blocks and their RangeInfo */
+	void buildDecodeSchedule();
+	/** Computes DecodeSchedule::poolRegions from the used domains and restricts
+	 *	the domain module to them (called by ::buildDecodeSchedule) */
+	void buildPoolRegions();
+	/** Computes the coefficients in ::schedule from the current domain pixels
+	 *	(using ::levelDomainStats, so it mustn't be used when decoding in place) */
+	void computeScheduleCoeffs();
+	/** Performs one decoding iteration (in place if set so), returns the sum
+	 *	of squared pixel changes if \p measure is true (otherwise zero) */
+	Real decodeIteration(bool measure);
 
 	/** Considers a domain on a \p level number \p domIndex (in \p pools and \p poolInfos)
 	 *	and sets \p block to the domain's block and returns a reference to its pool */
@@ -173,6 +262,12 @@ protected:
 	( const RangeNode &rangeBlock, const ISquareDomains::PoolList &pools
 	, const PoolInfos &poolInfos, int domIndex, int zoom, Block &block );
 
+	/** Fills \p seeds with the domains on \p range's level (with the same rotations)
+	 *	derived from the domains of \p seedRanges: quadrants of the parent's domain,
+	 *	domains containing the sons' domains, the neighbours' domains and their shifts */
+	void getRelatedSeeds( const RangeNode &range, const RangeList &seedRanges
+	, IStdEncPredictor::Predictions &seeds ) const;
+
 	/** Return iterator to the pool of domain with index \p domID */
 	static PoolInfos::const_iterator getPoolFromDomID( int domID, const PoolInfos &poolInfos );
 };
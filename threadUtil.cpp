@@ -0,0 +1,227 @@
+#include "threadUtil.h"
+
+#include <QThread>
+
+using namespace std;
+
+namespace NOSPACE {
+//	identification of the TaskPool worker running in the current thread (if any)
+	__thread TaskPool *currentPool= 0;
+	__thread int currentIndex= -1;
+//	the limiting group of the task being run by the current worker (if any)
+	__thread TaskGroup *currentLimiter= 0;
+
+//	the process-wide pool returned by TaskPool::shared and its lock
+	TaskPool *sharedPool= 0;
+	QMutex sharedMutex;
+}
+
+/** A worker thread of TaskPool, owns a deque of tasks */
+class TaskPool::Worker: public QThread {
+public:
+	TaskPool *pool;		///< the pool of the worker
+	int index;			///< the index of the worker in TaskPool::workers
+	ItemDeque items;	///< the deque of tasks started from within this worker
+	QMutex mutex;		///< the lock for #items
+
+	/** Only initializes the members, the thread isn't started */
+	Worker(TaskPool *pool_,int index_)
+	: pool(pool_), index(index_) {}
+protected:
+	/** Runs the tasks until the pool is quitting, sleeps when there's nothing to do
+	 *	(the queued tasks needn't be takeable because of their limiters, so the worker
+	 *	sleeps until the next TaskPool::wakeOne instead of checking the queued count) */
+	void run() {
+		currentPool= pool;
+		currentIndex= index;
+		while (true) {
+			int wakeups= pool->wakeups;
+			if ( pool->runOne(this,true) )
+				continue;
+			QMutexLocker locker(&pool->sleepMutex);
+			while ( !pool->quitting && pool->wakeups==wakeups )
+				pool->wakeCond.wait(&pool->sleepMutex);
+			if (pool->quitting)
+				return;
+		}
+	}
+}; // TaskPool::Worker class
+
+
+TaskPool::TaskPool(int threadCount)
+: queuedCount(0), pendingCount(0), wakeups(0)
+, blockedCount(0), quitting(false) {
+	ASSERT(threadCount>0);
+	workers.resize(threadCount);
+	for (int i=0; i<threadCount; ++i)
+		workers[i]= new Worker(this,i);
+	for (int i=0; i<threadCount; ++i)
+		workers[i]->start();
+}
+
+TaskPool::~TaskPool() {
+	ASSERT( injected.empty() && queuedCount<=0 && isIdle() && currentPool!=this );
+//	wake up all the workers and make them quit
+	{
+		QMutexLocker locker(&sleepMutex);
+		quitting= true;
+		wakeCond.wakeAll();
+	}
+	for (vector<Worker*>::iterator it=workers.begin(); it!=workers.end(); ++it) {
+		(*it)->wait();
+		ASSERT( (*it)->items.empty() );
+		delete *it;
+	}
+}
+
+TaskPool* TaskPool::current() {
+	return currentPool;
+}
+
+TaskPool& TaskPool::shared(int threadCount) {
+	QMutexLocker locker(&sharedMutex);
+	if (!sharedPool)
+		sharedPool= new TaskPool( max(threadCount,QThread::idealThreadCount()) );
+	return *sharedPool;
+}
+
+void TaskPool::destroyShared() {
+	QMutexLocker locker(&sharedMutex);
+	delete sharedPool;
+	sharedPool= 0;
+}
+
+void TaskPool::start(QRunnable *task,TaskGroup &group) {
+	ASSERT(task);
+	group.pending.ref();
+	pendingCount.ref();
+//	the group limits its tasks, unlimited groups inherit the limiter of the running task
+	Item item= { task, &group, group.limit ? &group : currentLimiter };
+//	workers push into their own deques, other threads into the common queue
+	if (currentPool==this) {
+		Worker *me= workers[currentIndex];
+		QMutexLocker locker(&me->mutex);
+		me->items.push_back(item);
+	} else {
+		QMutexLocker locker(&injectedMutex);
+		injected.push_back(item);
+	}
+	queuedCount.ref();
+	wakeOne();
+}
+
+void TaskPool::wait(TaskGroup &group) {
+	if (currentPool==this) {
+	//	a worker: help with other tasks until the group is finished,
+	//	sleep while there's nothing to help with (new tasks wake it up, see ::wakeOne)
+		Worker *me= workers[currentIndex];
+		while (group.pending) {
+			int lastWakeups= wakeups;
+			if ( runOne(me,false) )
+				continue;
+			QMutexLocker locker(&sleepMutex);
+			++blockedCount;
+			while ( group.pending && wakeups==lastWakeups )
+				doneCond.wait(&sleepMutex);
+			--blockedCount;
+		}
+	} else {
+	//	other threads: sleep until the group is finished
+		QMutexLocker locker(&sleepMutex);
+		while (group.pending)
+			doneCond.wait(&sleepMutex);
+	}
+}
+
+namespace NOSPACE {
+	/** Tries to take an item from the back or the front of a \p deque locked by \p mutex,
+	 *	the item is only taken if \p canTake allows it */
+	template<class Deque,class Item,class Check> bool takeItem
+	( Deque &deque, QMutex &mutex, bool fromBack, Check canTake, Item &item ) {
+		QMutexLocker locker(&mutex);
+		if ( deque.empty() || !canTake( fromBack ? deque.back() : deque.front() ) )
+			return false;
+		if (fromBack) {
+			item= deque.back();
+			deque.pop_back();
+		} else {
+			item= deque.front();
+			deque.pop_front();
+		}
+		return true;
+	}
+}
+
+bool TaskPool::runOne(Worker *me,bool preferInjected) {
+	ASSERT(me);
+	if ( queuedCount<=0 )
+		return false;
+	Item item;
+//	try my own deque (the newest task), possibly the injected tasks (the oldest one)
+	bool found= takeItem( me->items, me->mutex, true, &occupy, item )
+		|| ( preferInjected && takeItem( injected, injectedMutex, false, &occupy, item ) );
+//	try to steal the oldest task from other workers
+	int count= workers.size();
+	for (int i=1; !found && i<count; ++i) {
+		Worker *victim= workers[ (me->index+i) % count ];
+		found= takeItem( victim->items, victim->mutex, false, &occupy, item );
+	}
+//	try the injected tasks if not tried yet
+	if ( !found && !preferInjected )
+		found= takeItem( injected, injectedMutex, false, &occupy, item );
+
+	if (!found)
+		return false;
+	queuedCount.deref();
+	runItem(item);
+	return true;
+}
+
+bool TaskPool::occupy(const Item &item) {
+	TaskGroup *limiter= item.limiter;
+//	a worker running a task of the limiter already occupies a place in it
+	if ( !limiter || limiter==currentLimiter )
+		return true;
+	while (true) {
+		int running= limiter->running;
+		if ( running >= limiter->limit )
+			return false;
+		if ( limiter->running.testAndSetOrdered(running,running+1) )
+			return true;
+	}
+}
+
+void TaskPool::runItem(const Item &item) {
+//	the place was occupied by ::occupy when taking the item
+	TaskGroup *outerLimiter= currentLimiter;
+	bool occupied= item.limiter && item.limiter!=outerLimiter;
+	currentLimiter= item.limiter;
+	try {
+		item.task->run();
+	} catch (exception &e) {
+		item.group->failed= true;
+	}
+	currentLimiter= outerLimiter;
+	if ( item.task->autoDelete() )
+		delete item.task;
+//	leave the limiter while its group is pending (some of its tasks is running),
+//	the tasks of the limiter that couldn't be taken may be taken now
+	if (occupied) {
+		item.limiter->running.deref();
+		wakeOne();
+	}
+	pendingCount.deref();
+//	the group mustn't be touched after decrementing, it may be destroyed by a waiter
+	if ( !item.group->pending.deref() ) {
+		QMutexLocker locker(&sleepMutex);
+		doneCond.wakeAll();
+	}
+}
+
+void TaskPool::wakeOne() {
+	QMutexLocker locker(&sleepMutex);
+	++wakeups;
+	wakeCond.wakeOne();
+	if (blockedCount)
+		doneCond.wakeAll();
+}
@@ -0,0 +1,116 @@
+#ifndef THREADUTIL_HEADER_
+#define THREADUTIL_HEADER_
+
+#include "headers.h"
+
+#include <deque>
+#include <QAtomicInt>
+#include <QMutex>
+#include <QRunnable>
+#include <QWaitCondition>
+
+class TaskPool;
+
+/** A group of tasks started in a TaskPool that can be waited for as a whole.
+ *	The group can limit the number of workers running its tasks at once
+ *	(the limit also covers all the tasks started from within them). */
+class TaskGroup {
+	friend class TaskPool;
+
+	QAtomicInt pending		///  the number of started tasks that haven't finished yet
+	, running;				///< the number of workers running the tasks (if limited)
+	const int limit;		///< the maximum of #running (zero: no limit)
+	volatile bool failed;	///< set if any of the tasks has thrown an exception
+public:
+	/** Creates an empty group, its tasks run on at most \p maxThreads workers at once
+	 *	(zero: as many as the nearest limited group above allows, or all of them) */
+	explicit TaskGroup(int maxThreads=0)
+	: pending(0), running(0), limit(maxThreads), failed(false)
+		{ ASSERT(maxThreads>=0); }
+	/** Only checks that no task of the group is running */
+	~TaskGroup()
+		{ ASSERT(!pending && !running); }
+
+	/** Returns whether any of the finished tasks has thrown an exception */
+	bool hasFailed() const
+		{ return failed; }
+}; // TaskGroup class
+
+/** A pool of worker threads scheduling tasks by work-stealing.
+ *	Every worker has its own deque of tasks - tasks started from within a worker
+ *	are pushed to its back and the worker takes its newest tasks first,
+ *	while idle workers steal the oldest tasks from the others. Tasks started from
+ *	other threads go to a common FIFO queue. Waiting for a group from within
+ *	a worker executes other tasks meanwhile, so the tasks can split themselves
+ *	into subtasks and wait for them without blocking any thread. */
+class TaskPool {
+	class Worker; // forward declaration, defined in threadUtil.cpp
+	friend class Worker;
+
+	/** A started task together with its group */
+	struct Item {
+		QRunnable *task;	///< the task to run
+		TaskGroup *group;	///< the group to notify when the task is finished
+		TaskGroup *limiter;	///< the group limiting the number of workers (or zero)
+	};
+	typedef std::deque<Item> ItemDeque;
+
+	std::vector<Worker*> workers;	///< the worker threads (owned)
+	ItemDeque injected;				///< the tasks started from outside the workers
+	QMutex injectedMutex;			///< the lock for #injected
+	QAtomicInt queuedCount			///  the number of tasks in all the deques
+	, pendingCount;					///< the number of started tasks that haven't finished yet
+	QMutex sleepMutex;				///< the lock for sleeping and waking up
+	QWaitCondition wakeCond			///  signalled when tasks may be taken or on quitting
+	, doneCond;						///< signalled when a group is finished (or as #wakeCond)
+	volatile int wakeups;			///< incremented on every ::wakeOne (sleepers watch it)
+	int blockedCount;				///< the number of workers sleeping in ::wait (on #doneCond)
+	volatile bool quitting;			///< set when the pool is being destroyed
+
+public:
+	/** Creates a pool with \p threadCount worker threads and starts them */
+	explicit TaskPool(int threadCount);
+	/** Stops and destroys the worker threads, all the tasks have to be finished */
+	~TaskPool();
+
+	/** Returns the number of worker threads */
+	int threadCount() const
+		{ return workers.size(); }
+	/** Returns whether no started task is pending */
+	bool isIdle() const
+		{ return !pendingCount; }
+	/** Schedules a \p task to be run as a part of the \p group,
+	 *	deletes it after running if QRunnable::autoDelete() is true */
+	void start(QRunnable *task,TaskGroup &group);
+	/** Waits until all the tasks of the \p group are finished,
+	 *	when called from a worker, it runs other tasks meanwhile
+	 *	(and sleeps while there are none) */
+	void wait(TaskGroup &group);
+
+	/** Returns the pool whose worker is the calling thread (or zero) */
+	static TaskPool* current();
+
+	/** Returns the process-wide pool, it's created by the first call with
+	 *	max(\p threadCount,QThread::idealThreadCount()) workers and never changed later
+	 *	(larger requests are clamped to its size). The callers limit their concurrency
+	 *	by TaskGroup's \p maxThreads. */
+	static TaskPool& shared(int threadCount);
+	/** Destroys the process-wide pool (if it exists), to be called at exit */
+	static void destroyShared();
+
+protected:
+	/** Tries to find a task for worker \p me and run it, returns whether it succeeded.
+	 *	It tries \p me's own deque first, the injected tasks are tried before stealing
+	 *	only if \p preferInjected is true. */
+	bool runOne(Worker *me,bool preferInjected);
+	/** Returns whether the calling worker may take the \p item, in that case it also
+	 *	occupies a place in the item's limiter if it doesn't hold one yet */
+	static bool occupy(const Item &item);
+	/** Runs a taken task and notifies its group */
+	void runItem(const Item &item);
+	/** Wakes up a sleeping worker and the workers sleeping in ::wait
+	 *	(called after queuing a task or leaving a limiter) */
+	void wakeOne();
+}; // TaskPool class
+
+#endif // THREADUTIL_HEADER_
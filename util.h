@@ -167,6 +167,19 @@ public:
 		nextIndex+=count;
 		return result;
 	}
+	/** Frees all the fields, keeps the last bulk (if it's in use) to be reused */
+	void reset() {
+		T *kept= 0;
+		if (nextIndex<bulkCount) { // pools.back() is a normal bulk (not a big field)
+			kept= pools.back();
+			pools.pop_back();
+		}
+		for_each( pools, MultiDeleter() );
+		pools.clear();
+		if (kept)
+			pools.push_back(kept);
+		nextIndex= kept ? 0 : bulkCount;
+	}
 }; // BulkAllocator class
 
 /** Structure providing support for progress update and interruption (used for encoding) */